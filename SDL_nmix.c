@@ -1,266 +1,852 @@
 #include "SDL_nmix.h"
 
-static SDL_AudioSpec mixer = {0};
-static SDL_AudioDeviceID audio_device = 0;
-static NMIX_Source* playing_sources = NULL; // linked list of sources playing
-static float master_gain = 1.f;
+// the changes to a source that can be recorded in a batch
+typedef enum NMIX_CommandType {
+  NMIX_COMMAND_PLAY,
+  NMIX_COMMAND_PAUSE,
+  NMIX_COMMAND_STOP_AT,
+  NMIX_COMMAND_SET_GAIN,
+  NMIX_COMMAND_SET_PAN,
+  NMIX_COMMAND_SEEK,
+  NMIX_COMMAND_FADE,
+  NMIX_COMMAND_FADE_GAIN,
+  NMIX_COMMAND_SWEEP_PAN,
+  NMIX_COMMAND_SET_FILTER,
+  NMIX_COMMAND_SET_REVERB_SEND,
+  NMIX_COMMAND_SET_PITCH,
+  NMIX_COMMAND_SET_FREQUENCY
+} NMIX_CommandType;
+
+typedef struct NMIX_Command {
+  NMIX_CommandType type;
+  NMIX_Source* source;
+  union {
+    Uint64 time; // NMIX_COMMAND_PLAY, NMIX_COMMAND_STOP_AT
+    Sint64 frame; // NMIX_COMMAND_SEEK
+    float value; // NMIX_COMMAND_SET_GAIN, NMIX_COMMAND_SET_PAN,
+                 // NMIX_COMMAND_SET_REVERB_SEND, NMIX_COMMAND_SET_PITCH and
+                 // NMIX_COMMAND_SET_FREQUENCY
+    struct {
+      float target;
+      int length; // in sample frames, at the mixer rate
+      NMIX_FadeCurve curve;
+      SDL_bool stop; // the source stops at the end of the fade
+      SDL_bool play; // the source starts from silence if it is paused
+    } fade; // NMIX_COMMAND_FADE, NMIX_COMMAND_FADE_GAIN and
+            // NMIX_COMMAND_SWEEP_PAN
+    struct {
+      NMIX_FilterType type;
+      float cutoff;
+      float q;
+    } filter; // NMIX_COMMAND_SET_FILTER
+  } arg;
+} NMIX_Command;
+
+typedef struct NMIX_CommandQueue {
+  NMIX_Command* commands;
+  int count;
+  int capacity;
+} NMIX_CommandQueue;
+
+// size (in sample frames) of the scratch buffer holding converted data: it
+// is shared by all the sources of a mixer, so it stays in cache
+#define NMIX_SCRATCH_FRAMES 512
+
+// maximum size (in sample frames, at the mixer rate) of the data requested
+// from a source callback at once
+#define NMIX_CHUNK_FRAMES 1024
+
+// interval (in sample frames) at which the gains of a fading source are
+// computed, they are linearly interpolated in between
+#define NMIX_RAMP_STEP 64
+
+// the gain (-60 dB) that stands for silence in exponential fades
+#define NMIX_RAMP_FLOOR 0.001f
+
+// range of the pitch of sources
+#define NMIX_MIN_PITCH 0.25f
+#define NMIX_MAX_PITCH 4
+
+// largest wavetable of an oscillator, in samples
+#define NMIX_MAX_WAVETABLE 65536
+
+// number of emitters computed at once by NMIX_UpdateEmitters
+#define NMIX_EMITTER_BLOCK 64
+
+// fraction of the distance (in octaves) between the current cutoff of a
+// filter and the requested one, covered every NMIX_RAMP_STEP frames
+#define NMIX_FILTER_SMOOTHING 0.25f
+
+// size (in sample frames) of the blocks convolved by the reverb, which is
+// also its latency
+#define NMIX_REVERB_BLOCK 512
+
+// size (in complex values) of the FFTs of the reverb
+#define NMIX_REVERB_FFT (2 * NMIX_REVERB_BLOCK)
+
+// a convolution reverb: the mono data sent by the sources is convolved with
+// a stereo impulse response, split in partitions of NMIX_REVERB_BLOCK frames
+// (uniformly partitioned overlap-save convolution). The two channels of the
+// impulse response are the real and imaginary parts of a complex signal, so
+// that a single complex FFT convolves both. Complex values are stored as
+// interleaved real and imaginary parts.
+typedef struct NMIX_Reverb {
+  int nb_partitions;
+  float* spectra; // the FFT of each partition of the impulse response
+  float* history; // the FFT of the last nb_partitions input blocks
+  int history_pos; // index of the FFT of the last block in history
+  int pos; // number of frames of the current block already received
+  int tail; // frames left to play once nothing is sent (the reverb tail)
+  float input[NMIX_REVERB_FFT]; // the previous and the current input blocks
+  float output[2 * NMIX_REVERB_BLOCK]; // the stereo output of the last block
+  float work[2 * NMIX_REVERB_FFT]; // the buffer of the FFTs
+  float twiddles[NMIX_REVERB_FFT]; // the roots of unity of the FFT
+} NMIX_Reverb;
+
+// a ring of stereo frames with a single producer and a single consumer,
+// which only share the read and write positions: neither of them waits for
+// the other
+typedef struct NMIX_Ring {
+  float* frames;
+  Uint32 size; // in frames, a power of two
+  SDL_atomic_t write_pos; // frames written by the producer, wrapping
+  SDL_atomic_t read_pos; // frames read by the consumer, wrapping
+} NMIX_Ring;
+
+// number of events the queue of a mixer holds (a power of two)
+#define NMIX_EVENT_QUEUE_SIZE 256
+
+// the events sent by the mixer to the game: the mixer (locked) is the only
+// producer, and NMIX_PollEvent the only consumer
+typedef struct NMIX_EventQueue {
+  NMIX_Event events[NMIX_EVENT_QUEUE_SIZE];
+  SDL_atomic_t write_pos; // events sent, wrapping
+  SDL_atomic_t read_pos; // events polled, wrapping
+} NMIX_EventQueue;
+
+// interval (in milliseconds) at which the writer thread of a capture looks
+// for new data
+#define NMIX_CAPTURE_POLL_MS 10
+// largest data size a WAV header can record (the RIFF size is 36 bytes more),
+// in whole stereo float frames
+#define NMIX_WAV_MAX_DATA_SIZE ((SDL_MAX_UINT32 - 36) / 8 * 8)
+
+// a capture of the output of a mixer: the audio thread copies each buffer in
+// a ring, that a writer thread drains to the destination
+typedef struct NMIX_Capture {
+  SDL_RWops* dst;
+  int freedst; // dst is closed when the capture stops
+  NMIX_CaptureFormat format;
+  Sint64 header_pos; // position of the WAV header in dst
+  Sint64 data_size; // bytes written after the header (by the writer)
+  NMIX_Ring ring;
+  SDL_atomic_t dropped; // buffers dropped because the ring was full
+  SDL_atomic_t running; // cleared to stop the writer
+  SDL_atomic_t failed; // set if the writer couldn't write
+  SDL_Thread* thread;
+} NMIX_Capture;
+
+// the state of a mixer that renders ahead of its audio device: a thread
+// mixes blocks into a ring, which the device callback only copies
+typedef struct NMIX_RenderAhead {
+  NMIX_Mixer* mixer;
+  NMIX_Ring ring;
+  int block_frames; // size of the blocks mixed by the thread
+  int target_frames; // number of frames the thread keeps in the ring
+  float* block; // the block being mixed
+  int reported_underruns; // underruns already sent as events
+  SDL_sem* wake; // posted by the callback when it reads the ring
+  SDL_atomic_t running; // cleared to stop the thread
+  SDL_Thread* thread;
+} NMIX_RenderAhead;
+
+// the levels of a buffer, accumulated while it is mixed
+typedef struct NMIX_LevelSum {
+  float peak[2];
+  float squares[2]; // the sum of the squares of each channel
+  int clips;
+} NMIX_LevelSum;
+
+// all the state of a mixer
+struct NMIX_Mixer {
+  SDL_AudioSpec spec; // the format used for mixing
+  SDL_AudioDeviceID device; // 0 if the mixer is rendered with NMIX_MixerRender
+  SDL_AudioFormat device_format; // the samples are converted to it if needed
+  float* master_buffer; // the mix of a device that doesn't use floats
+                        // (spec.samples frames)
+  SDL_bool dither; // adds a dither when converting to 16 bit samples
+  Uint32 dither_state; // state of the random generator of the dither
+  SDL_mutex* lock; // held while mixing
+  NMIX_Source* playing_sources; // linked list of sources playing
+  float gain;
+  Uint64 time; // number of frames mixed since the mixer was created
+
+  SDL_bool batching; // set between NMIX_MixerBeginBatch/Commit
+  NMIX_CommandQueue batch; // changes recorded by the game thread
+  NMIX_CommandQueue committed; // changes waiting for the next buffer
+
+  NMIX_Filter filter; // applied on the output, once the sources are mixed
+  NMIX_Capture* capture; // NULL if the output isn't captured
+  NMIX_RenderAhead* ahead; // NULL if the output is mixed by the callback
+  SDL_atomic_t underruns; // buffers the render-ahead thread didn't fill
+  NMIX_EventQueue events;
+  NMIX_Meter meter; // the levels of the output
+  NMIX_LevelSum levels; // the levels of the source being mixed
+  NMIX_Reverb* reverb; // NULL if there is no reverb
+  float* send_buffer; // the mono data sent to the reverb by the sources
+  int send_buffer_frames;
+
+  float virtual_threshold; // sources at or below are not mixed
+  int max_voices; // maximum number of sources mixed, 0 = no limit
+  NMIX_Source** voices; // used to sort the sources by score
+  NMIX_Source** sources; // the sources created, detached by NMIX_FreeMixer
+  int voices_capacity; // capacity of voices and sources
+  int nb_sources; // number of sources created
+
+  // scratch buffers shared by all the sources, as they are mixed one after
+  // another: in_buffer receives the data of a source callback, out_buffer
+  // the data converted to the mixer format, and ramp_buffer the data of a
+  // filtered or fading source before its gains are applied
+  // (NMIX_SCRATCH_FRAMES frames)
+  void* in_buffer;
+  int in_buffer_size;
+  float* out_buffer;
+  int out_buffer_size;
+  float* ramp_buffer;
+  float* pitch_buffer; // the data resampled by a source with a pitch
+                       // (NMIX_SCRATCH_FRAMES * NMIX_MAX_PITCH + 3 frames)
+};
+
+// the mixer used by the functions that don't take a mixer (NMIX_OpenAudio)
+static NMIX_Mixer* default_mixer = NULL;
 
 static SDL_INLINE float clampf(float x, float min, float max) {
   return x < min ? min : (x > max ? max : x);
 }
 
+// the absolute value, inlined (SDL_fabs is a call) so that the loops of the
+// mixer vectorize
+static SDL_INLINE float absf(float x) {
+  return x < 0 ? -x : x;
+}
+
+// the bits of a float, to store it in an atomic int
+static SDL_INLINE int float_bits(float x) {
+  int bits;
+  SDL_memcpy(&bits, &x, sizeof(bits));
+  return bits;
+}
+
+static SDL_INLINE float bits_float(int bits) {
+  float x;
+  SDL_memcpy(&x, &bits, sizeof(x));
+  return x;
+}
+
+// publishes the levels of a buffer of "nb_frames" frames
+static void publish_levels(
+    NMIX_Meter* meter, const NMIX_LevelSum* sum, int nb_frames) {
+  for (int i = 0; i < 2; i++) {
+    float const rms = (float) SDL_sqrt(sum->squares[i] / nb_frames);
+    SDL_AtomicSet(&meter->peak[i], float_bits(sum->peak[i]));
+    SDL_AtomicSet(&meter->rms[i], float_bits(rms));
+  }
+  if (sum->clips > 0) {
+    SDL_AtomicAdd(&meter->clips, sum->clips);
+  }
+}
+
+// sets the levels of a meter to silence (its clips are kept)
+static void reset_levels(NMIX_Meter* meter) {
+  for (int i = 0; i < 2; i++) {
+    SDL_AtomicSet(&meter->peak[i], 0);
+    SDL_AtomicSet(&meter->rms[i], 0);
+  }
+}
+
+// reads the levels of a meter
+static void read_levels(NMIX_Meter* meter, NMIX_Levels* levels) {
+  for (int i = 0; i < 2; i++) {
+    levels->peak[i] = bits_float(SDL_AtomicGet(&meter->peak[i]));
+    levels->rms[i] = bits_float(SDL_AtomicGet(&meter->rms[i]));
+  }
+  levels->clips = SDL_AtomicGet(&meter->clips);
+}
+
 // mixes two samples "a" and "b" together
 static SDL_INLINE float mix_samples(float a, float b) {
   // there are a lot of better ways to mix two samples together,
   // however this turns out to be simple to implement, quick to execute,
-  // and good enough for a lot of cases.
-  return clampf(a + b, -1, 1);
+  // and good enough for a lot of cases. The sum is only clamped once all
+  // the sources are mixed, at the end of render.
+  return a + b;
 }
 
-// apply linear panning to two samples (pan must be between -1 and 1)
-static SDL_INLINE void apply_panning(float pan, float* left, float* right) {
+// computes the gains of the left and right channels of a source with linear
+// panning (pan must be between -1 and 1)
+static SDL_INLINE void pan_gains(
+    float pan, float gain, float* left, float* right) {
   float amplitude = pan / 2 + 0.5;
-  *left *= 1 - amplitude;
-  *right *= amplitude;
+  *left = gain * (1 - amplitude);
+  *right = gain * amplitude;
 }
 
-// the callback used by SDL_nmix to mix all the sources together
-static void SDLCALL nmix_callback(
-    void* userdata, Uint8* _buffer, int buffer_size) {
-  SDL_memset(_buffer, 0, buffer_size);
-  int const sample_size = SDL_AUDIO_SAMPLELEN(mixer.format);
+// the value of a ramp at mixer time "time"
+static float ramp_value(const NMIX_Ramp* ramp, Uint64 time) {
+  if (ramp->length == 0 || time >= ramp->start + ramp->length) {
+    return ramp->to;
+  }
+  if (time <= ramp->start) {
+    return ramp->from;
+  }
 
-  if (playing_sources == NULL) {
-    return;
+  float x = (float) (time - ramp->start) / ramp->length;
+  if (ramp->curve == NMIX_FADE_EQUAL_POWER) {
+    // sin for a rising ramp and cos for a falling one, so that the sum of
+    // the powers of two sources crossfaded stays constant
+    x = ramp->to > ramp->from ? (float) SDL_sin(x * (float) M_PI / 2)
+                              : 1 - (float) SDL_cos(x * (float) M_PI / 2);
+  } else if (ramp->curve == NMIX_FADE_EXPONENTIAL) {
+    // the same ratio for every frame, silence being replaced by -60 dB
+    float const from = SDL_max(ramp->from, NMIX_RAMP_FLOOR);
+    float const to = SDL_max(ramp->to, NMIX_RAMP_FLOOR);
+    return from * (float) SDL_pow(to / from, x);
   }
+  return ramp->from + (ramp->to - ramp->from) * x;
+}
 
-  // retrieving audio data for each voice currently playing
-  NMIX_Source* s = playing_sources;
-  while (s != NULL) {
-    NMIX_Source* next = s->next;
+// whether a ramp is still moving at mixer time "time"
+static SDL_INLINE SDL_bool ramp_moving(const NMIX_Ramp* ramp, Uint64 time) {
+  return ramp->length > 0 && ramp->start + ramp->length > time;
+}
+
+// the mixer time at which a ramp stops its source, SDL_MAX_UINT64 if none
+static SDL_INLINE Uint64 ramp_stop_time(const NMIX_Ramp* ramp) {
+  if (ramp->length == 0 || !ramp->stop) {
+    return SDL_MAX_UINT64;
+  }
+  return ramp->start + ramp->length;
+}
+
+// starts a ramp from its value at mixer time "time" to "target"
+static void start_ramp(NMIX_Ramp* ramp, Uint64 time, float target, int length,
+    NMIX_FadeCurve curve, SDL_bool stop) {
+  ramp->from = ramp_value(ramp, time);
+  ramp->to = target;
+  ramp->start = time;
+  ramp->length = length;
+  ramp->curve = curve;
+  ramp->stop = stop;
+}
+
+// sets a ramp to a constant value
+static SDL_INLINE void set_ramp(NMIX_Ramp* ramp, float value) {
+  ramp->from = value;
+  ramp->to = value;
+  ramp->length = 0;
+  ramp->stop = SDL_FALSE;
+}
+
+// computes the coefficients of a filter for its current cutoff (from the
+// Audio EQ Cookbook by Robert Bristow-Johnson)
+static void filter_coefficients(NMIX_Filter* f, int rate) {
+  float const w0 = 2 * (float) M_PI * f->current_cutoff / rate;
+  float const cos_w0 = (float) SDL_cos(w0);
+  float const alpha = (float) SDL_sin(w0) / (2 * f->q);
+  float const a0 = 1 + alpha;
+
+  float b0, b1, b2;
+  switch (f->type) {
+  case NMIX_FILTER_HIGHPASS:
+    b0 = (1 + cos_w0) / 2;
+    b1 = -(1 + cos_w0);
+    b2 = b0;
+    break;
+  case NMIX_FILTER_BANDPASS:
+    b0 = alpha;
+    b1 = 0;
+    b2 = -alpha;
+    break;
+  default:
+    b0 = (1 - cos_w0) / 2;
+    b1 = 1 - cos_w0;
+    b2 = b0;
+    break;
+  }
+
+  f->b0 = b0 / a0;
+  f->b1 = b1 / a0;
+  f->b2 = b2 / a0;
+  f->a1 = -2 * cos_w0 / a0;
+  f->a2 = (1 - alpha) / a0;
+}
+
+// changes the parameters of a filter running at "rate": only the cutoff
+// moves progressively, when the filter was already applied
+static void set_filter(NMIX_Filter* f, NMIX_FilterType type, float cutoff,
+    float q, int rate) {
+  cutoff = clampf(cutoff, 10, rate * 0.45f);
+  if (f->type == NMIX_FILTER_NONE) {
+    SDL_zeroa(f->z1);
+    SDL_zeroa(f->z2);
+    f->current_cutoff = cutoff;
+  }
+
+  f->type = type;
+  f->cutoff = cutoff;
+  f->q = q;
+  if (type != NMIX_FILTER_NONE) {
+    filter_coefficients(f, rate);
+  }
+}
 
-    int bytes_written = 0;
-    while (bytes_written < buffer_size) {
-      // calculating the copy size
-      int copy_size = SDL_AudioStreamAvailable(s->stream);
+// filters "count" stereo frames in place, the cutoff moving toward the
+// requested one every NMIX_RAMP_STEP frames
+static void filter_frames(NMIX_Filter* f, float* buffer, int count, int rate) {
+  // transposed direct form II, the two channels being two parallel lanes
+  float z1[2] = {f->z1[0], f->z1[1]};
+  float z2[2] = {f->z2[0], f->z2[1]};
 
-      if (copy_size > s->out_buffer_size) {
-        copy_size = s->out_buffer_size;
+  for (int i = 0; i < count; i += NMIX_RAMP_STEP) {
+    if (f->current_cutoff != f->cutoff) {
+      float const ratio = f->cutoff / f->current_cutoff;
+      if (ratio > 0.999f && ratio < 1.001f) {
+        f->current_cutoff = f->cutoff;
+      } else {
+        f->current_cutoff *= (float) SDL_pow(ratio, NMIX_FILTER_SMOOTHING);
       }
-      if (bytes_written + copy_size > buffer_size) {
-        copy_size = buffer_size - bytes_written;
+      filter_coefficients(f, rate);
+    }
+
+    float const b0 = f->b0, b1 = f->b1, b2 = f->b2, a1 = f->a1, a2 = f->a2;
+    int const n = SDL_min(count - i, NMIX_RAMP_STEP);
+    float* frames = buffer + 2 * i;
+    for (int j = 0; j < n; j++) {
+      for (int c = 0; c < 2; c++) {
+        float const x = frames[2 * j + c];
+        float const y = b0 * x + z1[c];
+        z1[c] = b1 * x - a1 * y + z2[c];
+        z2[c] = b2 * x - a2 * y;
+        frames[2 * j + c] = y;
       }
+    }
+  }
+
+  for (int c = 0; c < 2; c++) {
+    f->z1[c] = z1[c];
+    f->z2[c] = z2[c];
+  }
+}
 
-      // retrieving bytes from converter
-      int bytes_read = SDL_AudioStreamGet(s->stream, s->out_buffer, copy_size);
+// in-place FFT (radix-2, decimation in time) of NMIX_REVERB_FFT complex
+// values, the inverse FFT is not scaled
+static void reverb_fft(const float* twiddles, float* x, SDL_bool inverse) {
+  int const n = NMIX_REVERB_FFT;
 
-      // copying those bytes to buffer, mixing them with existing samples
-      float* const buffer = (float*) (_buffer + bytes_written);
-      float* const out_buffer = (float*) s->out_buffer;
-      for (int i = 0; i < bytes_read / sample_size; i += 2) {
-        float sl = out_buffer[i] * s->gain * master_gain;
-        float sr = out_buffer[i + 1] * s->gain * master_gain;
-        apply_panning(s->pan, &sl, &sr);
+  // bit-reversal permutation
+  for (int i = 1, j = 0; i < n; i++) {
+    int bit = n >> 1;
+    for (; j & bit; bit >>= 1) {
+      j ^= bit;
+    }
+    j ^= bit;
+    if (i < j) {
+      float const re = x[2 * i], im = x[2 * i + 1];
+      x[2 * i] = x[2 * j];
+      x[2 * i + 1] = x[2 * j + 1];
+      x[2 * j] = re;
+      x[2 * j + 1] = im;
+    }
+  }
 
-        buffer[i] = mix_samples(buffer[i], sl);
-        buffer[i + 1] = mix_samples(buffer[i + 1], sr);
+  float const sign = inverse ? -1.f : 1.f;
+  for (int len = 2; len <= n; len <<= 1) {
+    int const half = len / 2;
+    int const stride = n / len;
+    for (int i = 0; i < n; i += len) {
+      for (int k = 0; k < half; k++) {
+        float const wr = twiddles[2 * k * stride];
+        float const wi = sign * twiddles[2 * k * stride + 1];
+        float* const a = x + 2 * (i + k);
+        float* const b = x + 2 * (i + k + half);
+        float const tr = b[0] * wr - b[1] * wi;
+        float const ti = b[0] * wi + b[1] * wr;
+        b[0] = a[0] - tr;
+        b[1] = a[1] - ti;
+        a[0] += tr;
+        a[1] += ti;
       }
+    }
+  }
+}
+
+// creates a reverb for an impulse response of "frames" frames (float
+// samples, 1 or 2 channels)
+static NMIX_Reverb* new_reverb(const float* ir, int frames, Uint8 channels) {
+  // the impulse response is normalized so that its energy is 1
+  double energy = 0;
+  for (int i = 0; i < frames * channels; i++) {
+    energy += (double) ir[i] * ir[i];
+  }
+  energy /= channels;
+  if (energy <= 0) {
+    SDL_SetError("The impulse response is silent.");
+    return NULL;
+  }
 
-      bytes_written += bytes_read;
+  NMIX_Reverb* r = SDL_calloc(1, sizeof(NMIX_Reverb));
+  if (r == NULL) {
+    SDL_OutOfMemory();
+    return NULL;
+  }
 
-      // if there's no more data available in converter, send
-      // more data to it
-      if (SDL_AudioStreamAvailable(s->stream) == 0) {
-        if (!s->eof) {
-          // retrieve new data
-          s->callback(s->userdata, s->in_buffer, s->in_buffer_size);
+  int const n = NMIX_REVERB_FFT;
+  r->nb_partitions = (frames + NMIX_REVERB_BLOCK - 1) / NMIX_REVERB_BLOCK;
+  size_t const size = (size_t) r->nb_partitions * 2 * n * sizeof(float);
+  r->spectra = SDL_malloc(size);
+  r->history = SDL_calloc(1, size);
+  if (r->spectra == NULL || r->history == NULL) {
+    SDL_free(r->spectra);
+    SDL_free(r->history);
+    SDL_free(r);
+    SDL_OutOfMemory();
+    return NULL;
+  }
 
-          // and push it to the converter
-          if (SDL_AudioStreamPut(s->stream, s->in_buffer, s->in_buffer_size) !=
-              0) {
-            fprintf(stderr, "SDL_nmix: FATAL: %s\n", SDL_GetError());
-            return;
-          }
-        } else {
-          // end of file, we remove the source from playing_sources
-          // list by calling NMIX_Pause.
-          NMIX_Pause(s);
+  for (int k = 0; k < n / 2; k++) {
+    r->twiddles[2 * k] = (float) SDL_cos(-2 * (float) M_PI * k / n);
+    r->twiddles[2 * k + 1] = (float) SDL_sin(-2 * (float) M_PI * k / n);
+  }
 
-          // no more data to write, skip remaining bytes
-          bytes_written = buffer_size;
-        }
+  // the scaling of the inverse FFT is applied to the spectra
+  float const scale = 1 / ((float) SDL_sqrt((float) energy) * n);
+  for (int p = 0; p < r->nb_partitions; p++) {
+    float* const spectrum = r->spectra + (size_t) p * 2 * n;
+    SDL_memset(spectrum, 0, 2 * n * sizeof(float));
+    for (int i = 0; i < NMIX_REVERB_BLOCK; i++) {
+      int const frame = p * NMIX_REVERB_BLOCK + i;
+      if (frame >= frames) {
+        break;
       }
+      const float* const in = ir + frame * channels;
+      spectrum[2 * i] = in[0] * scale;
+      spectrum[2 * i + 1] = in[channels - 1] * scale;
     }
-
-    s = next;
+    reverb_fft(r->twiddles, spectrum, SDL_FALSE);
   }
+
+  return r;
 }
 
-int NMIX_OpenAudio(const char* device, int rate, int samples) {
-  if (audio_device != 0) {
-    SDL_SetError("NMIX device is already opened.");
-    return -1;
+static void free_reverb(NMIX_Reverb* r) {
+  if (r == NULL) {
+    return;
   }
+  SDL_free(r->spectra);
+  SDL_free(r->history);
+  SDL_free(r);
+}
 
-  SDL_version linked;
-  SDL_GetVersion(&linked);
-  if (SDL_VERSIONNUM(linked.major, linked.minor, linked.patch) <
-      SDL_VERSIONNUM(2, 0, 7)) {
-    SDL_SetError("SDL_nmix requires SDL 2.0.7 or later.");
-    return -1;
+// convolves the last two input blocks with the impulse response, the
+// result for the last block going into the output
+static void reverb_block(NMIX_Reverb* r) {
+  int const n = NMIX_REVERB_FFT;
+  int const nb_partitions = r->nb_partitions;
+
+  // the FFT of the input goes into the history
+  r->history_pos = (r->history_pos + 1) % nb_partitions;
+  float* const spectrum = r->history + (size_t) r->history_pos * 2 * n;
+  for (int i = 0; i < n; i++) {
+    spectrum[2 * i] = r->input[i];
+    spectrum[2 * i + 1] = 0;
   }
+  reverb_fft(r->twiddles, spectrum, SDL_FALSE);
 
-  if (!SDL_WasInit(SDL_INIT_AUDIO)) {
-    if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0) {
-      return -1;
+  // the block received p blocks ago is multiplied by the partition p
+  float* const y = r->work;
+  SDL_memset(y, 0, 2 * n * sizeof(float));
+  for (int p = 0; p < nb_partitions; p++) {
+    int const index = (r->history_pos - p + nb_partitions) % nb_partitions;
+    const float* const x = r->history + (size_t) index * 2 * n;
+    const float* const h = r->spectra + (size_t) p * 2 * n;
+    for (int k = 0; k < n; k++) {
+      y[2 * k] += x[2 * k] * h[2 * k] - x[2 * k + 1] * h[2 * k + 1];
+      y[2 * k + 1] += x[2 * k] * h[2 * k + 1] + x[2 * k + 1] * h[2 * k];
     }
   }
+  reverb_fft(r->twiddles, y, SDL_TRUE);
 
-  // SDL_nmix uses float32 (AUDIO_F32SYS) samples for mixing, and only
-  // supports stereo output
-  SDL_AudioSpec wanted_spec = {0};
-  wanted_spec.freq = rate;
-  wanted_spec.format = AUDIO_F32SYS;
-  wanted_spec.channels = 2;
-  wanted_spec.samples = samples;
-  wanted_spec.callback = nmix_callback;
-  wanted_spec.userdata = NULL;
+  // the second half holds the convolution of the last block (the first one
+  // is aliased), its real and imaginary parts being the two channels
+  SDL_memcpy(r->output, y + n, 2 * NMIX_REVERB_BLOCK * sizeof(float));
+  SDL_memcpy(r->input, r->input + NMIX_REVERB_BLOCK,
+      NMIX_REVERB_BLOCK * sizeof(float));
+}
 
-  audio_device = SDL_OpenAudioDevice(
-      device, 0, &wanted_spec, &mixer, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
-  if (audio_device == 0) {
-    return -1;
-  }
+// sends "nb_frames" mono frames to the reverb, and adds its output to the
+// stereo buffer
+static void reverb_process(
+    NMIX_Reverb* r, const float* send, float* buffer, int nb_frames) {
+  while (nb_frames > 0) {
+    int const count = SDL_min(nb_frames, NMIX_REVERB_BLOCK - r->pos);
+    SDL_memcpy(r->input + NMIX_REVERB_BLOCK + r->pos, send,
+        count * sizeof(float));
 
-  NMIX_PausePlayback(SDL_FALSE);
+    const float* const out = r->output + 2 * r->pos;
+    for (int i = 0; i < count * 2; i++) {
+      buffer[i] = mix_samples(buffer[i], out[i]);
+    }
 
-  return 0;
+    r->pos += count;
+    if (r->pos == NMIX_REVERB_BLOCK) {
+      reverb_block(r);
+      r->pos = 0;
+    }
+
+    send += count;
+    buffer += count * 2;
+    nb_frames -= count;
+  }
 }
 
-int NMIX_CloseAudio(void) {
-  if (audio_device == 0) {
-    SDL_SetError("NMIX device is already closed.");
+// allocates the frames of a ring holding at least "min_frames" frames
+static int init_ring(NMIX_Ring* r, Uint32 min_frames) {
+  r->size = 1;
+  while (r->size < min_frames) {
+    r->size *= 2;
+  }
+  r->frames = SDL_malloc(r->size * 2 * sizeof(float));
+  if (r->frames == NULL) {
+    SDL_OutOfMemory();
     return -1;
   }
-  SDL_PauseAudioDevice(audio_device, 1);
-  SDL_CloseAudioDevice(audio_device);
-  audio_device = 0;
+  SDL_AtomicSet(&r->write_pos, 0);
+  SDL_AtomicSet(&r->read_pos, 0);
   return 0;
 }
 
-void NMIX_PausePlayback(SDL_bool pause_on) {
-  SDL_PauseAudioDevice(audio_device, pause_on);
+// the number of frames that can be read from a ring
+static SDL_INLINE Uint32 ring_fill(NMIX_Ring* r) {
+  return (Uint32) SDL_AtomicGet(&r->write_pos) -
+         (Uint32) SDL_AtomicGet(&r->read_pos);
 }
 
-float NMIX_GetMasterGain(void) {
-  return master_gain;
+// copies frames at the end of a ring, which must have room for them (called
+// by the producer)
+static void ring_write(NMIX_Ring* r, const float* frames, Uint32 nb_frames) {
+  Uint32 const write = (Uint32) SDL_AtomicGet(&r->write_pos);
+  Uint32 const start = write & (r->size - 1);
+  Uint32 const first = SDL_min(nb_frames, r->size - start);
+  SDL_memcpy(r->frames + 2 * start, frames, first * 2 * sizeof(float));
+  SDL_memcpy(r->frames, frames + 2 * first,
+      (nb_frames - first) * 2 * sizeof(float));
+  SDL_AtomicSet(&r->write_pos, (int) (write + nb_frames));
 }
 
-void NMIX_SetMasterGain(float gain) {
-  master_gain = clampf(gain, 0, 2);
+// returns the number of frames that can be read in one piece from a ring,
+// "*frames" receiving their address (called by the consumer, which owns
+// them until it calls ring_consume)
+static Uint32 ring_span(NMIX_Ring* r, float** frames) {
+  Uint32 const read = (Uint32) SDL_AtomicGet(&r->read_pos);
+  Uint32 const start = read & (r->size - 1);
+  *frames = r->frames + 2 * start;
+  return SDL_min(ring_fill(r), r->size - start);
 }
 
-SDL_AudioSpec* NMIX_GetAudioSpec(void) {
-  return &mixer;
+// frees the first "nb_frames" frames of a ring (called by the consumer)
+static SDL_INLINE void ring_consume(NMIX_Ring* r, Uint32 nb_frames) {
+  SDL_AtomicAdd(&r->read_pos, (int) nb_frames);
 }
 
-SDL_AudioDeviceID NMIX_GetAudioDevice(void) {
-  return audio_device;
+// copies frames from the beginning of a ring, which must hold them (called
+// by the consumer)
+static void ring_read(NMIX_Ring* r, float* frames, Uint32 nb_frames) {
+  while (nb_frames > 0) {
+    float* data;
+    Uint32 const n = SDL_min(ring_span(r, &data), nb_frames);
+    SDL_memcpy(frames, data, n * 2 * sizeof(float));
+    ring_consume(r, n);
+    frames += 2 * n;
+    nb_frames -= n;
+  }
 }
 
-NMIX_Source* NMIX_NewSource(SDL_AudioFormat format, Uint8 channels, int rate,
-    NMIX_SourceCallback callback, void* userdata) {
-  if (audio_device == 0) {
-    SDL_SetError("Please open NMIX device before creating sources.");
-    return NULL;
+// copies a buffer of the output in the ring of a capture, called by the
+// audio thread. The buffer is dropped if the ring is full.
+static void capture_frames(
+    NMIX_Capture* c, const float* frames, int nb_frames) {
+  if (c->ring.size - ring_fill(&c->ring) < (Uint32) nb_frames) {
+    SDL_AtomicIncRef(&c->dropped);
+    return;
   }
+  ring_write(&c->ring, frames, nb_frames);
+}
 
-  NMIX_Source* source = SDL_malloc(sizeof(NMIX_Source));
-  if (source == NULL) {
-    SDL_OutOfMemory();
-    return NULL;
+// writes frames of the ring to the destination of a capture
+static void write_capture(NMIX_Capture* c, float* frames, Uint32 nb_frames) {
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+  // WAV files are little endian, the writer owns these frames until it
+  // consumes them
+  if (c->format == NMIX_CAPTURE_WAV) {
+    for (Uint32 i = 0; i < 2 * nb_frames; i++) {
+      frames[i] = SDL_SwapFloatLE(frames[i]);
+    }
   }
+#endif
+  if (SDL_RWwrite(c->dst, frames, 2 * sizeof(float), nb_frames) != nb_frames) {
+    SDL_AtomicSet(&c->failed, 1);
+  }
+  c->data_size += nb_frames * 2 * sizeof(float);
+}
 
-  source->format = format;
-  source->channels = channels;
-  source->rate = rate;
-  source->pan = 0.f;
-  source->gain = 1.f;
-  source->callback = callback;
-  source->userdata = userdata;
-  source->eof = SDL_FALSE;
+// the writer thread of a capture: it drains the ring until the capture is
+// stopped and the ring is empty
+static int SDLCALL capture_thread(void* data) {
+  NMIX_Capture* const c = (NMIX_Capture*) data;
+  for (;;) {
+    // read before the ring, so that the last frames are written
+    int const running = SDL_AtomicGet(&c->running);
+    float* frames;
+    Uint32 const n = ring_span(&c->ring, &frames);
+    if (n > 0) {
+      write_capture(c, frames, n);
+      ring_consume(&c->ring, n);
+    } else if (running) {
+      SDL_Delay(NMIX_CAPTURE_POLL_MS);
+    } else {
+      return 0;
+    }
+  }
+}
 
-  // allocating the internal buffers:
-  // note: we allocate roughly the size needed to store all the samples
-  // that correspond to one nmix callback.
-  int in_nb_samples = source->rate * mixer.samples / mixer.freq;
-  source->in_buffer_size =
-      in_nb_samples * source->channels * SDL_AUDIO_SAMPLELEN(source->format);
-  source->in_buffer = SDL_malloc(source->in_buffer_size);
-  if (source->in_buffer == NULL) {
-    SDL_OutOfMemory();
-    return NULL;
+// writes the header of a WAV file of stereo float samples, with "data_size"
+// bytes of data. The sizes are clamped to what the header can hold: the
+// data of a longer capture is still written, readers that trust the header
+// ignore what is past about 3 hours at 48000 Hz.
+static int write_wav_header(SDL_RWops* dst, int rate, Sint64 total_size) {
+  Uint32 const data_size =
+      (Uint32) SDL_min(total_size, (Sint64) NMIX_WAV_MAX_DATA_SIZE);
+  Uint32 const header[11] = {
+      SDL_SwapLE32(0x46464952), // "RIFF"
+      SDL_SwapLE32(36 + data_size),
+      SDL_SwapLE32(0x45564157), // "WAVE"
+      SDL_SwapLE32(0x20746D66), // "fmt "
+      SDL_SwapLE32(16),
+      SDL_SwapLE32(3 | 2 << 16), // WAVE_FORMAT_IEEE_FLOAT, 2 channels
+      SDL_SwapLE32(rate),
+      SDL_SwapLE32(rate * 2 * sizeof(float)), // bytes per second
+      SDL_SwapLE32(2 * sizeof(float) | 32 << 16), // frame size, bits
+      SDL_SwapLE32(0x61746164), // "data"
+      SDL_SwapLE32(data_size)};
+  if (SDL_RWwrite(dst, header, sizeof(header), 1) != 1) {
+    SDL_SetError("Error while writing the capture.");
+    return -1;
   }
+  return 0;
+}
 
-  source->out_buffer_size = mixer.size;
-  source->out_buffer = SDL_malloc(source->out_buffer_size);
-  if (source->out_buffer == NULL) {
-    SDL_OutOfMemory();
-    return NULL;
+// grows a command queue so that it can hold at least "count" commands
+static int reserve_commands(NMIX_CommandQueue* queue, int count) {
+  if (count <= queue->capacity) {
+    return 0;
+  }
+
+  int capacity = queue->capacity > 0 ? queue->capacity : 64;
+  while (capacity < count) {
+    capacity *= 2;
   }
 
-  source->stream = SDL_NewAudioStream(source->format, source->channels,
-      source->rate, mixer.format, mixer.channels, mixer.freq);
-  if (source->stream == NULL) {
+  NMIX_Command* commands =
+      SDL_realloc(queue->commands, capacity * sizeof(NMIX_Command));
+  if (commands == NULL) {
     SDL_OutOfMemory();
-    return NULL;
+    return -1;
   }
 
-  source->prev = NULL;
-  source->next = NULL;
+  queue->commands = commands;
+  queue->capacity = capacity;
+  return 0;
+}
 
-  return source;
+// records a command in the current batch
+static int record_command(NMIX_Mixer* m, const NMIX_Command* command) {
+  if (reserve_commands(&m->batch, m->batch.count + 1) != 0) {
+    return -1;
+  }
+  m->batch.commands[m->batch.count++] = *command;
+  return 0;
 }
 
-void NMIX_FreeSource(NMIX_Source* source) {
-  if (source == NULL) {
-    return;
+// removes all the commands of a queue that refer to "source"
+static void purge_commands(NMIX_CommandQueue* queue, NMIX_Source* source) {
+  int count = 0;
+  for (int i = 0; i < queue->count; i++) {
+    if (queue->commands[i].source != source) {
+      queue->commands[count++] = queue->commands[i];
+    }
   }
+  queue->count = count;
+}
 
-  SDL_LockAudioDevice(audio_device);
-  if (NMIX_IsPlaying(source)) {
-    NMIX_Pause(source);
+// sends an event to the game, the mixer must be locked. The event is lost
+// if the queue is full.
+static void push_event(NMIX_Mixer* m, NMIX_EventType type, NMIX_Source* s) {
+  NMIX_EventQueue* const q = &m->events;
+  Uint32 const write = (Uint32) SDL_AtomicGet(&q->write_pos);
+  if (write - (Uint32) SDL_AtomicGet(&q->read_pos) >= NMIX_EVENT_QUEUE_SIZE) {
+    return;
   }
 
-  SDL_free(source->in_buffer);
-  SDL_free(source->out_buffer);
-  SDL_FreeAudioStream(source->stream);
-  SDL_free(source);
-  SDL_UnlockAudioDevice(audio_device);
+  NMIX_Event* const event = &q->events[write & (NMIX_EVENT_QUEUE_SIZE - 1)];
+  event->type = type;
+  event->source = s;
+  event->time = m->time;
+  SDL_AtomicSet(&q->write_pos, (int) (write + 1));
 }
 
-int NMIX_Play(NMIX_Source* source) {
-  if (source == NULL) {
-    return -1;
-  }
+// the following functions modify the state of a source, they must be called
+// with the mixer locked (or while mixing)
+
+// the phase of an oscillator is a Uint32, a full period being 2^32 (so
+// that it wraps around by itself): returns the phase advance over "frames"
+// frames at the sampling rate "rate"
+static Uint32 phase_step(const NMIX_Oscillator* o, double frames, int rate) {
+  double const periods = frames * o->frequency / rate;
+  return (Uint32) (Uint64) ((periods - SDL_floor(periods)) * 4294967296.0);
+}
 
-  SDL_LockAudioDevice(audio_device);
+static int play_source(NMIX_Source* source, Uint64 time) {
+  NMIX_Mixer* const m = source->mixer;
 
   // cannot play a source that is already being played
   if (NMIX_IsPlaying(source)) {
-    SDL_UnlockAudioDevice(audio_device);
     SDL_SetError("source is already playing");
     return -1;
   }
 
   source->eof = SDL_FALSE;
+  source->start_time = time;
+
+  source->pitch_phase = 0;
+  source->pitch_buffered = 0;
+  SDL_zeroa(source->pitch_frames);
+
+  // the filter doesn't ring with the data of the previous playback
+  NMIX_Filter* const filter = &source->filter;
+  SDL_zeroa(filter->z1);
+  SDL_zeroa(filter->z2);
+  if (filter->type != NMIX_FILTER_NONE &&
+      filter->current_cutoff != filter->cutoff) {
+    filter->current_cutoff = filter->cutoff;
+    filter_coefficients(filter, m->spec.freq);
+  }
 
   // no sources currently playing, so we set the first source
-  if (playing_sources == NULL) {
-    playing_sources = source;
+  if (m->playing_sources == NULL) {
+    m->playing_sources = source;
   } else {
     // find the last source currently playing
-    NMIX_Source* v = playing_sources;
+    NMIX_Source* v = m->playing_sources;
     while (v->next) {
       v = v->next;
     }
@@ -269,24 +855,22 @@ int NMIX_Play(NMIX_Source* source) {
     v->next = source;
     source->prev = v;
   }
-
-  SDL_UnlockAudioDevice(audio_device);
+  SDL_AtomicSet(&source->playing, 1);
 
   return 0;
 }
 
-void NMIX_Pause(NMIX_Source* source) {
-  if (source == NULL) {
-    return;
-  }
-
-  SDL_LockAudioDevice(audio_device);
-
+static void pause_source(NMIX_Source* source) {
   if (!NMIX_IsPlaying(source)) {
-    SDL_UnlockAudioDevice(audio_device);
     return;
   }
 
+  // the automation in progress ends at its target, and a fade at full level
+  // if the source was fading out to stop
+  set_ramp(&source->fade, source->fade.stop ? 1.f : source->fade.to);
+  set_ramp(&source->gain_ramp, source->gain);
+  set_ramp(&source->pan_ramp, source->pan);
+
   // we remove the source from the list
   if (source->next) {
     source->next->prev = source->prev;
@@ -296,46 +880,2490 @@ void NMIX_Pause(NMIX_Source* source) {
     source->prev->next = source->next;
   } else {
     // first element in list
-    playing_sources = source->next;
+    source->mixer->playing_sources = source->next;
   }
 
   source->prev = NULL;
   source->next = NULL;
-
-  SDL_UnlockAudioDevice(audio_device);
+  source->stop_time = SDL_MAX_UINT64;
+  SDL_AtomicSet(&source->playing, 0);
+  reset_levels(&source->meter);
 }
 
-SDL_bool NMIX_IsPlaying(NMIX_Source* source) {
-  if (source == NULL) {
-    return SDL_FALSE;
+// stops a source that reached its end or its stop time, and tells the game
+static void finish_source(NMIX_Source* source) {
+  if (!NMIX_IsPlaying(source)) {
+    return;
   }
-  return source == playing_sources || source->prev != NULL;
+  pause_source(source);
+  push_event(source->mixer, NMIX_EVENT_FINISHED, source);
 }
 
-float NMIX_GetPan(NMIX_Source* source) {
-  if (source == NULL) {
+static int seek_source(NMIX_Source* source, Sint64 frame) {
+  // an oscillator moves its phase, to the one it would have after "frame"
+  // frames from phase 0
+  if (source->oscillator != NULL) {
+    NMIX_Oscillator* const o = source->oscillator;
+    o->phase = phase_step(o, (double) SDL_max(frame, 0), source->rate);
     return 0;
   }
-  return source->pan;
+
+  if (source->seek == NULL) {
+    SDL_SetError("source cannot seek");
+    return -1;
+  }
+
+  if (source->seek(source->userdata, frame) != 0) {
+    return -1;
+  }
+
+  // the data converted for the old position must not be played
+  if (source->stream != NULL) {
+    SDL_AudioStreamClear(source->stream);
+  }
+  source->skip_credit = 0;
+  source->pitch_buffered = 0;
+  return 0;
 }
 
-void NMIX_SetPan(NMIX_Source* source, float pan) {
-  if (source == NULL) {
-    return;
+// starts a fade of a source from its current level to "target"
+static void fade_source(NMIX_Source* source, float target, int length,
+    NMIX_FadeCurve curve, SDL_bool stop, SDL_bool play) {
+  NMIX_Mixer* const m = source->mixer;
+
+  if (play && !NMIX_IsPlaying(source)) {
+    set_ramp(&source->fade, 0.f);
+    if (play_source(source, 0) != 0) {
+      return;
+    }
+  }
+
+  start_ramp(&source->fade, m->time, target, length, curve, stop);
+  if (length == 0 && stop) {
+    pause_source(source);
   }
-  source->pan = clampf(pan, -1, 1);
 }
 
-float NMIX_GetGain(NMIX_Source* source) {
-  if (source == NULL) {
-    return 0;
+// starts the automation of the gain of a source
+static void fade_gain(NMIX_Source* source, float target, int length,
+    NMIX_FadeCurve curve, SDL_bool stop) {
+  // the ramp starts from the current gain if it isn't moving
+  if (source->gain_ramp.length == 0) {
+    set_ramp(&source->gain_ramp, source->gain);
+  }
+  start_ramp(&source->gain_ramp, source->mixer->time, target, length, curve,
+      stop);
+  source->gain = target;
+  if (length == 0 && stop) {
+    pause_source(source);
   }
-  return source->gain;
 }
 
-void NMIX_SetGain(NMIX_Source* source, float gain) {
-  if (source == NULL) {
+// starts the automation of the panning of a source
+static void sweep_pan(NMIX_Source* source, float target, int length) {
+  if (source->pan_ramp.length == 0) {
+    set_ramp(&source->pan_ramp, source->pan);
+  }
+  start_ramp(&source->pan_ramp, source->mixer->time, target, length,
+      NMIX_FADE_LINEAR, SDL_FALSE);
+  source->pan = target;
+}
+
+// sets the gain of a source, cancelling its automation. The mixer must be
+// locked: the callback would otherwise see the ramp still running.
+static SDL_INLINE void set_gain(NMIX_Source* source, float gain) {
+  source->gain = gain;
+  source->gain_ramp.length = 0;
+}
+
+// sets the panning of a source, cancelling its automation (the mixer must
+// be locked)
+static SDL_INLINE void set_pan(NMIX_Source* source, float pan) {
+  source->pan = pan;
+  source->pan_ramp.length = 0;
+}
+
+static void apply_command(const NMIX_Command* command) {
+  NMIX_Source* source = command->source;
+
+  switch (command->type) {
+  case NMIX_COMMAND_PLAY: play_source(source, command->arg.time); break;
+  case NMIX_COMMAND_PAUSE: pause_source(source); break;
+  case NMIX_COMMAND_STOP_AT: source->stop_time = command->arg.time; break;
+  case NMIX_COMMAND_SET_GAIN: set_gain(source, command->arg.value); break;
+  case NMIX_COMMAND_SET_PAN: set_pan(source, command->arg.value); break;
+  case NMIX_COMMAND_SEEK: seek_source(source, command->arg.frame); break;
+  case NMIX_COMMAND_FADE:
+    fade_source(source, command->arg.fade.target, command->arg.fade.length,
+        command->arg.fade.curve, command->arg.fade.stop,
+        command->arg.fade.play);
+    break;
+  case NMIX_COMMAND_FADE_GAIN:
+    fade_gain(source, command->arg.fade.target, command->arg.fade.length,
+        command->arg.fade.curve, command->arg.fade.stop);
+    break;
+  case NMIX_COMMAND_SWEEP_PAN:
+    sweep_pan(source, command->arg.fade.target, command->arg.fade.length);
+    break;
+  case NMIX_COMMAND_SET_REVERB_SEND:
+    source->reverb_send = command->arg.value;
+    break;
+  case NMIX_COMMAND_SET_PITCH: source->pitch = command->arg.value; break;
+  case NMIX_COMMAND_SET_FREQUENCY:
+    source->oscillator->frequency = command->arg.value;
+    break;
+  case NMIX_COMMAND_SET_FILTER:
+    set_filter(&source->filter, command->arg.filter.type,
+        command->arg.filter.cutoff, command->arg.filter.q,
+        source->mixer->spec.freq);
+    break;
+  }
+}
+
+// the loudness of a source, used to decide whether it should be mixed
+static SDL_INLINE float source_loudness(NMIX_Source* s) {
+  // a source fading in is considered at its target level, so that it isn't
+  // virtual at the beginning of the fade
+  Uint64 const time = s->mixer->time;
+  float gain = s->gain;
+  if (s->gain_ramp.length > 0) {
+    gain = SDL_max(gain, ramp_value(&s->gain_ramp, time));
+  }
+  float const fade = ramp_value(&s->fade, time);
+  return gain * SDL_max(fade, s->fade.to);
+}
+
+// sorts sources by decreasing score (the address is only used so that the
+// order of sources with the same score doesn't change between callbacks)
+static int SDLCALL compare_voices(const void* a, const void* b) {
+  NMIX_Source* const sa = *(NMIX_Source* const*) a;
+  NMIX_Source* const sb = *(NMIX_Source* const*) b;
+  if (sa->score != sb->score) {
+    return sa->score > sb->score ? -1 : 1;
+  }
+  return sa < sb ? -1 : (sa > sb ? 1 : 0);
+}
+
+static void set_virtual(NMIX_Source* s, SDL_bool virtual_on) {
+  if (virtual_on && !s->virtualized) {
+    // the data already converted won't be played: the frames it holds are
+    // the first ones to be skipped while the source is virtual
+    SDL_AudioSpec* const spec = &s->mixer->spec;
+    int const frame_size = SDL_AUDIO_SAMPLELEN(spec->format) * spec->channels;
+    if (s->stream != NULL) {
+      s->skip_credit = SDL_AudioStreamAvailable(s->stream) / frame_size;
+      SDL_AudioStreamClear(s->stream);
+    }
+  }
+  s->virtualized = virtual_on;
+}
+
+// decides which sources are mixed ("real") in this callback, and which are
+// only virtual: inaudible sources, and the sources with the lowest
+// priority * loudness when there are more than max_voices
+static void select_voices(NMIX_Mixer* m) {
+  int count = 0;
+  for (NMIX_Source* s = m->playing_sources; s != NULL; s = s->next) {
+    float loudness = source_loudness(s);
+    s->score = loudness > m->virtual_threshold ? s->priority * loudness : -1;
+
+    if (m->max_voices > 0 && s->score >= 0) {
+      m->voices[count++] = s;
+    }
+  }
+
+  if (m->max_voices > 0 && count > m->max_voices) {
+    SDL_qsort(m->voices, count, sizeof(NMIX_Source*), compare_voices);
+    for (int i = m->max_voices; i < count; i++) {
+      m->voices[i]->score = -1;
+      if (!m->voices[i]->virtualized) {
+        push_event(m, NMIX_EVENT_STOLEN, m->voices[i]);
+      }
+    }
+  }
+
+  for (NMIX_Source* s = m->playing_sources; s != NULL; s = s->next) {
+    set_virtual(s, s->score < 0);
+  }
+}
+
+// retrieves at most "len" bytes of data from a source, "*data" pointing to
+// them: either to the data lent by the source, or to the scratch buffer
+// filled by its callback. Returns the number of bytes retrieved (a whole
+// number of frames), 0 meaning the end of the source.
+static int pull_source(NMIX_Source* s, const void** data, int len) {
+  if (s->lend == NULL) {
+    s->callback(s->userdata, s->mixer->in_buffer, len);
+    *data = s->mixer->in_buffer;
+    return len;
+  }
+
+  int const frame_size = SDL_AUDIO_SAMPLELEN(s->format) * s->channels;
+  int received = s->lend(s->userdata, data, len);
+  received = SDL_min(received, len);
+  received -= received % frame_size;
+  if (received <= 0) {
+    s->eof = SDL_TRUE;
+    return 0;
+  }
+  return received;
+}
+
+// sin(pi * t) for t in [-1, 1]: the argument is folded in [0, 0.5], where a
+// polynomial is accurate to 4e-6, so that the loops calling it vectorize
+static SDL_INLINE float sine_pi(float t) {
+  float const a = 0.5f - absf(absf(t) - 0.5f);
+  float const a2 = a * a;
+  float const y =
+      a * (3.14159265f +
+              a2 * (-5.16771278f +
+                       a2 * (2.55016404f +
+                                a2 * (-0.599264529f + a2 * 0.0821458866f))));
+  return t < 0 ? -y : y;
+}
+
+// "phase" as a number between -1 and 1 (at half the period)
+static SDL_INLINE float phase_signed(Uint32 phase) {
+  return (Sint32) phase * (1.f / 2147483648.f);
+}
+
+// advances a virtual source by "nb_frames" (at the mixer rate), without
+// converting nor mixing its data
+static void skip_source(NMIX_Source* s, int nb_frames) {
+  if (s->oscillator != NULL) {
+    s->oscillator->phase += phase_step(s->oscillator, nb_frames, s->rate);
+    return;
+  }
+
+  int const credit = SDL_min(s->skip_credit, nb_frames);
+  s->skip_credit -= credit;
+  nb_frames -= credit;
+
+  // converting to the source rate, keeping the remainder so that the
+  // position doesn't drift
+  Sint64 const n = (Sint64) nb_frames * s->rate + s->skip_remainder;
+  int frames = n / s->mixer->spec.freq;
+  s->skip_remainder = n % s->mixer->spec.freq;
+
+  if (s->eof) {
+    finish_source(s);
+    return;
+  }
+  if (frames == 0) {
+    return;
+  }
+
+  if (s->skip != NULL) {
+    // the source can skip data by itself, less frames skipped means EOF
+    if (s->skip(s->userdata, frames) < frames) {
+      finish_source(s);
+    }
+    return;
+  }
+
+  // otherwise, the data is retrieved and dropped
+  int const frame_size = SDL_AUDIO_SAMPLELEN(s->format) * s->channels;
+  int const in_frames = s->in_buffer_size / frame_size;
+  while (frames > 0 && !s->eof) {
+    const void* data;
+    int const count = SDL_min(frames, in_frames);
+    frames -= pull_source(s, &data, count * frame_size) / frame_size;
+  }
+  if (s->eof) {
+    finish_source(s);
+  }
+}
+
+// adds a frame to the levels of a buffer
+static SDL_INLINE void measure_frame(
+    NMIX_LevelSum* sum, float left, float right) {
+  float const l = absf(left);
+  float const r = absf(right);
+  sum->peak[0] = SDL_max(sum->peak[0], l);
+  sum->peak[1] = SDL_max(sum->peak[1], r);
+  sum->squares[0] += left * left;
+  sum->squares[1] += right * right;
+  sum->clips += (l > 1) + (r > 1);
+}
+
+// mixes a stereo frame into the buffer, and adds it to the levels
+static SDL_INLINE void mix_frame(
+    float* out, float left, float right, NMIX_LevelSum* sum) {
+  out[0] = mix_samples(out[0], left);
+  out[1] = mix_samples(out[1], right);
+  measure_frame(sum, left, right);
+}
+
+// mixes "count" frames of source data into the stereo buffer: the data is
+// converted (mono to stereo, Sint16 to float) and panned on the fly, "left"
+// and "right" being the gains of each channel. The frames are measured
+// into "levels" at the same time.
+static void mix_frames(float* buffer, const void* data, SDL_AudioFormat format,
+    Uint8 channels, int count, float left, float right,
+    NMIX_LevelSum* levels) {
+  // the levels are kept in registers while mixing
+  NMIX_LevelSum sum = *levels;
+  if (format == AUDIO_S16SYS) {
+    const Sint16* in = (const Sint16*) data;
+    float const l = left / 32768.f;
+    float const r = right / 32768.f;
+    if (channels == 1) {
+      for (int i = 0; i < count; i++) {
+        mix_frame(buffer + 2 * i, in[i] * l, in[i] * r, &sum);
+      }
+    } else {
+      for (int i = 0; i < count; i++) {
+        mix_frame(buffer + 2 * i, in[2 * i] * l, in[2 * i + 1] * r, &sum);
+      }
+    }
+  } else {
+    const float* in = (const float*) data;
+    if (channels == 1) {
+      for (int i = 0; i < count; i++) {
+        mix_frame(buffer + 2 * i, in[i] * left, in[i] * right, &sum);
+      }
+    } else {
+      for (int i = 0; i < count; i++) {
+        mix_frame(
+            buffer + 2 * i, in[2 * i] * left, in[2 * i + 1] * right, &sum);
+      }
+    }
+  }
+  *levels = sum;
+}
+
+// mixes "nb_frames" frames of an oscillator into the buffer, with the gains
+// "left" and "right": the phase of each frame only depends on its index, so
+// that the loops (but the noise) vectorize
+static void mix_oscillator(NMIX_Source* s, float* buffer, int nb_frames,
+    float left, float right, NMIX_LevelSum* levels) {
+  NMIX_Oscillator* const o = s->oscillator;
+  Uint32 const step = phase_step(o, s->pitch, s->rate);
+  Uint32 const phase = o->phase;
+  NMIX_LevelSum sum = *levels;
+
+  switch (o->waveform) {
+  case NMIX_WAVE_SINE:
+    for (int i = 0; i < nb_frames; i++) {
+      float const x = sine_pi(phase_signed(phase + i * step));
+      mix_frame(buffer + 2 * i, x * left, x * right, &sum);
+    }
+    break;
+  case NMIX_WAVE_SQUARE:
+    for (int i = 0; i < nb_frames; i++) {
+      float const x = 1.f - 2.f * (float) ((phase + i * step) >> 31);
+      mix_frame(buffer + 2 * i, x * left, x * right, &sum);
+    }
+    break;
+  case NMIX_WAVE_SAW:
+    for (int i = 0; i < nb_frames; i++) {
+      float const x = phase_signed(phase + i * step + 0x80000000u);
+      mix_frame(buffer + 2 * i, x * left, x * right, &sum);
+    }
+    break;
+  case NMIX_WAVE_TRIANGLE:
+    for (int i = 0; i < nb_frames; i++) {
+      float const x = 1.f - 2.f * absf(phase_signed(phase + i * step));
+      mix_frame(buffer + 2 * i, x * left, x * right, &sum);
+    }
+    break;
+  case NMIX_WAVE_NOISE:
+    for (int i = 0; i < nb_frames; i++) {
+      // xorshift32
+      o->noise ^= o->noise << 13;
+      o->noise ^= o->noise >> 17;
+      o->noise ^= o->noise << 5;
+      float const x = phase_signed(o->noise);
+      mix_frame(buffer + 2 * i, x * left, x * right, &sum);
+    }
+    break;
+  case NMIX_WAVE_TABLE: {
+    // the top bits of the phase index the table, the others interpolate
+    const float* table = o->table;
+    int const shift = 32 - o->table_bits;
+    for (int i = 0; i < nb_frames; i++) {
+      Uint32 const p = phase + i * step;
+      Uint32 const k = p >> shift;
+      float const x = ((p << o->table_bits) >> 8) * (1.f / 16777216.f);
+      float const y = table[k] + (table[k + 1] - table[k]) * x;
+      mix_frame(buffer + 2 * i, y * left, y * right, &sum);
+    }
+    break;
+  }
+  }
+
+  o->phase = phase + (Uint32) nb_frames * step;
+  *levels = sum;
+}
+
+// mixes "nb_frames" frames of a source that is read directly (without
+// SDL_AudioStream) into the buffer, with the gains "left" and "right"
+static void mix_source_direct(NMIX_Source* s, float* buffer, int nb_frames,
+    float left, float right) {
+  int const frame_size = SDL_AUDIO_SAMPLELEN(s->format) * s->channels;
+  int const in_frames = s->in_buffer_size / frame_size;
+
+  while (nb_frames > 0) {
+    if (s->eof) {
+      // end of file, we remove the source from playing_sources list
+      finish_source(s);
+      return;
+    }
+
+    const void* data;
+    int const count =
+        pull_source(s, &data, SDL_min(nb_frames, in_frames) * frame_size) /
+        frame_size;
+    mix_frames(buffer, data, s->format, s->channels, count, left, right,
+        &s->mixer->levels);
+
+    buffer += count * 2;
+    nb_frames -= count;
+  }
+}
+
+// mixes "nb_frames" frames of a source into the buffer, with the gains
+// "left" and "right"
+static void mix_source(
+    NMIX_Source* s, float* buffer, int nb_frames, float left, float right) {
+  if (s->oscillator != NULL) {
+    mix_oscillator(s, buffer, nb_frames, left, right, &s->mixer->levels);
+    return;
+  }
+  if (s->stream == NULL) {
+    mix_source_direct(s, buffer, nb_frames, left, right);
+    return;
+  }
+
+  NMIX_Mixer* const m = s->mixer;
+  int const frame_size = SDL_AUDIO_SAMPLELEN(m->spec.format) * m->spec.channels;
+
+  while (nb_frames > 0) {
+    // retrieving frames from converter
+    int copy_size = SDL_AudioStreamAvailable(s->stream);
+    copy_size = SDL_min(copy_size, m->out_buffer_size);
+    copy_size = SDL_min(copy_size, nb_frames * frame_size);
+    int frames_read =
+        SDL_AudioStreamGet(s->stream, m->out_buffer, copy_size) / frame_size;
+
+    // mixing them with existing samples
+    mix_frames(buffer, m->out_buffer, m->spec.format, m->spec.channels,
+        frames_read, left, right, &m->levels);
+
+    buffer += frames_read * 2;
+    nb_frames -= frames_read;
+
+    // if there's no more data available in converter, send
+    // more data to it
+    if (SDL_AudioStreamAvailable(s->stream) == 0) {
+      if (!s->eof) {
+        // retrieve new data
+        const void* data;
+        int const len = pull_source(s, &data, s->in_buffer_size);
+
+        // and push it to the converter
+        if (len > 0 && SDL_AudioStreamPut(s->stream, data, len) != 0) {
+          fprintf(stderr, "SDL_nmix: FATAL: %s\n", SDL_GetError());
+          return;
+        }
+      } else {
+        // end of file, we remove the source from playing_sources list
+        finish_source(s);
+        return;
+      }
+    }
+  }
+}
+
+// whether the data of a source is resampled for its pitch (oscillators
+// apply their pitch to their frequency instead)
+static SDL_INLINE SDL_bool source_pitched(NMIX_Source* s) {
+  return s->pitch != 1.f && s->oscillator == NULL;
+}
+
+// whether the gains of a source change after mixer time "time"
+static SDL_INLINE SDL_bool source_ramping(NMIX_Source* s, Uint64 time) {
+  return ramp_moving(&s->fade, time) || ramp_moving(&s->gain_ramp, time) ||
+         ramp_moving(&s->pan_ramp, time);
+}
+
+// advances a virtual source by "nb_frames" frames of the mix, at its pitch:
+// the fraction of frame is kept in the resampling position, so that the
+// source doesn't drift, and the frames read ahead are skipped first
+static void skip_pitched_source(NMIX_Source* s, int nb_frames) {
+  float const position = s->pitch_phase + nb_frames * s->pitch;
+  int const frames = (int) position;
+  int const ahead = SDL_min(s->pitch_buffered, frames);
+  s->pitch_phase = position - frames;
+  s->pitch_buffered -= ahead;
+  SDL_memmove(s->pitch_frames, s->pitch_frames + 2 * ahead,
+      2 * (1 + s->pitch_buffered) * sizeof(float));
+  skip_source(s, frames - ahead);
+}
+
+// mixes "nb_frames" frames of a source with a pitch into a zeroed stereo
+// buffer, at unity gain: the data is mixed in the pitch buffer after the
+// frames kept from the previous call, then resampled with a linear
+// interpolation
+static void mix_pitched_source(NMIX_Source* s, float* buffer, int nb_frames) {
+  NMIX_Mixer* const m = s->mixer;
+  float* const in = m->pitch_buffer;
+  float const pitch = s->pitch;
+  float const phase = s->pitch_phase;
+
+  // frame 0 is the last frame consumed, it may be followed by one frame
+  // read ahead: the frames are read up to the one after the last position,
+  // and consumed up to the one before the next position
+  int const buffered = s->pitch_buffered;
+  SDL_memcpy(in, s->pitch_frames, 2 * (1 + buffered) * sizeof(float));
+  int const last = (int) (phase + (nb_frames - 1) * pitch) + 1;
+  int const consumed = (int) (phase + nb_frames * pitch);
+  int const count = SDL_max(last, consumed);
+  float* const frames = in + 2 * (1 + buffered);
+  SDL_memset(frames, 0, 2 * (count - buffered) * sizeof(float));
+  mix_source(s, frames, count - buffered, 1.f, 1.f);
+
+  for (int i = 0; i < nb_frames; i++) {
+    float const position = phase + i * pitch;
+    int const k = (int) position;
+    float const x = position - k;
+    buffer[2 * i] += in[2 * k] + (in[2 * k + 2] - in[2 * k]) * x;
+    buffer[2 * i + 1] += in[2 * k + 1] + (in[2 * k + 3] - in[2 * k + 1]) * x;
+  }
+
+  s->pitch_phase = phase + nb_frames * pitch - consumed;
+  s->pitch_buffered = count - consumed;
+  SDL_memcpy(s->pitch_frames, in + 2 * consumed,
+      2 * (1 + s->pitch_buffered) * sizeof(float));
+}
+
+// the gains of the left and right channels of a source at mixer time "time"
+static SDL_INLINE void source_gains(
+    NMIX_Source* s, Uint64 time, float* left, float* right) {
+  float gain = s->gain;
+  float pan = s->pan;
+  if (s->gain_ramp.length > 0) {
+    gain = ramp_value(&s->gain_ramp, time);
+  }
+  if (s->pan_ramp.length > 0) {
+    pan = ramp_value(&s->pan_ramp, time);
+  }
+  float const fade = ramp_value(&s->fade, time);
+  pan_gains(pan, gain * fade * s->mixer->gain, left, right);
+}
+
+// mixes "nb_frames" frames of a source which has a pitch, is filtered, is
+// sent to the reverb, or whose gains change (fade, gain or pan automation)
+// into the buffer, starting at mixer time "time": the data is mixed at unity
+// gain in the ramp buffer (resampled and filtered), then added to the buffer
+// (and to the mono "send" buffer if it isn't NULL) with gains computed every
+// NMIX_RAMP_STEP frames and interpolated in between, so that the level
+// changes smoothly
+static void mix_processed_source(NMIX_Source* s, float* buffer, float* send,
+    int nb_frames, Uint64 time) {
+  NMIX_Mixer* const m = s->mixer;
+
+  float left, right;
+  source_gains(s, time, &left, &right);
+
+  // the data mixed at unity gain is measured too: the levels of the source
+  // are the ones measured with its gains
+  NMIX_LevelSum sum;
+  SDL_zero(sum);
+
+  while (nb_frames > 0 && NMIX_IsPlaying(s)) {
+    int const count = SDL_min(nb_frames, NMIX_SCRATCH_FRAMES);
+    SDL_memset(m->ramp_buffer, 0, count * 2 * sizeof(float));
+    if (source_pitched(s)) {
+      mix_pitched_source(s, m->ramp_buffer, count);
+    } else {
+      mix_source(s, m->ramp_buffer, count, 1.f, 1.f);
+    }
+    if (s->filter.type != NMIX_FILTER_NONE) {
+      filter_frames(&s->filter, m->ramp_buffer, count, m->spec.freq);
+    }
+
+    for (int i = 0; i < count; i += NMIX_RAMP_STEP) {
+      int const n = SDL_min(count - i, NMIX_RAMP_STEP);
+      float next_left, next_right;
+      source_gains(s, time + n, &next_left, &next_right);
+
+      float const dl = (next_left - left) / n;
+      float const dr = (next_right - right) / n;
+      const float* in = m->ramp_buffer + 2 * i;
+      float* out = buffer + 2 * i;
+      for (int j = 0; j < n; j++) {
+        mix_frame(out + 2 * j, in[2 * j] * (left + dl * j),
+            in[2 * j + 1] * (right + dr * j), &sum);
+      }
+      if (send != NULL) {
+        float const level = s->reverb_send;
+        float* const mono = send + i;
+        for (int j = 0; j < n; j++) {
+          mono[j] += (in[2 * j] * (left + dl * j) +
+                         in[2 * j + 1] * (right + dr * j)) *
+                     level;
+        }
+      }
+
+      left = next_left;
+      right = next_right;
+      time += n;
+    }
+
+    buffer += count * 2;
+    if (send != NULL) {
+      send += count;
+    }
+    nb_frames -= count;
+  }
+
+  m->levels = sum;
+}
+
+// grows the buffer receiving the data sent to the reverb, so that it holds
+// "nb_frames" frames (it only happens when rendering offline, with buffers
+// larger than the size of the mixer)
+static int reserve_send_buffer(NMIX_Mixer* m, int nb_frames) {
+  if (nb_frames <= m->send_buffer_frames) {
+    return 0;
+  }
+  float* buffer = SDL_realloc(m->send_buffer, nb_frames * sizeof(float));
+  if (buffer == NULL) {
+    return -1;
+  }
+  m->send_buffer = buffer;
+  m->send_buffer_frames = nb_frames;
+  return 0;
+}
+
+// mixes all the sources together, the mixer must be locked
+static void render(NMIX_Mixer* m, Uint8* _buffer, int buffer_size) {
+  SDL_memset(_buffer, 0, buffer_size);
+  int const frame_size = SDL_AUDIO_SAMPLELEN(m->spec.format) * m->spec.channels;
+  int const nb_frames = buffer_size / frame_size;
+
+  // applying the batches committed since the last buffer, so that all
+  // their changes are heard from the beginning of this buffer
+  for (int i = 0; i < m->committed.count; i++) {
+    apply_command(&m->committed.commands[i]);
+  }
+  m->committed.count = 0;
+
+  select_voices(m);
+
+  float* send_buffer = NULL;
+  if (m->reverb != NULL && reserve_send_buffer(m, nb_frames) == 0) {
+    send_buffer = m->send_buffer;
+    SDL_memset(send_buffer, 0, nb_frames * sizeof(float));
+  }
+  SDL_bool sending = SDL_FALSE;
+
+  // retrieving audio data for each voice currently playing
+  NMIX_Source* s = m->playing_sources;
+  while (s != NULL) {
+    NMIX_Source* next = s->next;
+
+    // the source may start or stop in the middle of this buffer: we only mix
+    // the frames in the range [first_frame, last_frame)
+    if (s->start_time >= m->time + nb_frames) {
+      s = next;
+      continue;
+    }
+    int first_frame = 0;
+    if (s->start_time > m->time) {
+      first_frame = s->start_time - m->time;
+    }
+    Uint64 stop_time = SDL_min(s->stop_time, ramp_stop_time(&s->fade));
+    stop_time = SDL_min(stop_time, ramp_stop_time(&s->gain_ramp));
+    int last_frame = nb_frames;
+    SDL_bool stopping = SDL_FALSE;
+    if (stop_time <= m->time + nb_frames) {
+      last_frame = stop_time > m->time ? stop_time - m->time : 0;
+      stopping = SDL_TRUE;
+    }
+
+    if (first_frame < last_frame) {
+      int const count = last_frame - first_frame;
+      SDL_zero(m->levels);
+      float* buffer = (float*) _buffer + first_frame * m->spec.channels;
+      SDL_bool const send = send_buffer != NULL && s->reverb_send > 0;
+      if (s->virtualized) {
+        skip_pitched_source(s, count);
+      } else if (send || source_pitched(s) ||
+                 s->filter.type != NMIX_FILTER_NONE ||
+                 source_ramping(s, m->time + first_frame)) {
+        mix_processed_source(s, buffer, send ? send_buffer + first_frame : NULL,
+            count, m->time + first_frame);
+        sending = sending || send;
+      } else {
+        float left, right;
+        source_gains(s, m->time + first_frame, &left, &right);
+        mix_source(s, buffer, count, left, right);
+      }
+
+      publish_levels(&s->meter, &m->levels, count);
+      if (!NMIX_IsPlaying(s)) {
+        reset_levels(&s->meter);
+      }
+    }
+
+    // the scheduled stop time is reached
+    if (stopping) {
+      finish_source(s);
+    }
+
+    // the automation is over at the end of this buffer
+    Uint64 const end = m->time + nb_frames;
+    if (s->fade.length > 0 && !ramp_moving(&s->fade, end)) {
+      set_ramp(&s->fade, s->fade.to);
+    }
+    if (s->gain_ramp.length > 0 && !ramp_moving(&s->gain_ramp, end)) {
+      s->gain_ramp.length = 0;
+    }
+    if (s->pan_ramp.length > 0 && !ramp_moving(&s->pan_ramp, end)) {
+      s->pan_ramp.length = 0;
+    }
+
+    s = next;
+  }
+
+  // the reverb runs while sources send data to it, and until its tail is
+  // over (its state is then only made of zeros, and it can be skipped)
+  NMIX_Reverb* const reverb = m->reverb;
+  if (send_buffer != NULL && (sending || reverb->tail > 0)) {
+    reverb_process(reverb, send_buffer, (float*) _buffer, nb_frames);
+    if (sending) {
+      reverb->tail = (reverb->nb_partitions + 2) * NMIX_REVERB_BLOCK;
+    } else {
+      reverb->tail -= SDL_min(reverb->tail, nb_frames);
+    }
+  }
+
+  // the master filter is applied once all the sources are mixed
+  float* const buffer = (float*) _buffer;
+  if (m->filter.type != NMIX_FILTER_NONE) {
+    filter_frames(&m->filter, buffer, nb_frames, m->spec.freq);
+  }
+
+  // the output is measured before it is clamped, to count the clips
+  NMIX_LevelSum sum;
+  SDL_zero(sum);
+  for (int i = 0; i < nb_frames; i++) {
+    measure_frame(&sum, buffer[2 * i], buffer[2 * i + 1]);
+    buffer[2 * i] = clampf(buffer[2 * i], -1, 1);
+    buffer[2 * i + 1] = clampf(buffer[2 * i + 1], -1, 1);
+  }
+  if (nb_frames > 0) {
+    publish_levels(&m->meter, &sum, nb_frames);
+  }
+
+  if (m->capture != NULL) {
+    capture_frames(m->capture, buffer, nb_frames);
+  }
+
+  m->time += nb_frames;
+}
+
+// returns a random number between 0 and 1 (xorshift32, the state can't be 0)
+static SDL_INLINE float dither_random(Uint32* state) {
+  Uint32 x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return (float) (x >> 8) * (1.f / 16777216.f);
+}
+
+// rounds a sample to the nearest integer (without a call to a libm function,
+// so that the conversion loops can be vectorized)
+static SDL_INLINE float round_sample(float x) {
+  return x + (x < 0 ? -.5f : .5f);
+}
+
+// converts mixed samples (between -1 and 1) to the format of the device
+static void convert_output(
+    NMIX_Mixer* m, const float* in, void* _out, int nb_samples) {
+  if (m->device_format == AUDIO_S16SYS) {
+    Sint16* const out = (Sint16*) _out;
+    if (m->dither) {
+      // triangular (TPDF) dither of +/-1 LSB: it turns the quantization
+      // error into a constant white noise, instead of a distortion that
+      // follows the signal (audible on quiet sounds and fade outs)
+      Uint32 state = m->dither_state;
+      for (int i = 0; i < nb_samples; i++) {
+        float const noise = dither_random(&state) - dither_random(&state);
+        float const x = in[i] * 32767.f + noise;
+        out[i] = (Sint16) round_sample(clampf(x, -32768.f, 32767.f));
+      }
+      m->dither_state = state;
+    } else {
+      for (int i = 0; i < nb_samples; i++) {
+        out[i] = (Sint16) round_sample(in[i] * 32767.f);
+      }
+    }
+  } else {
+    // 32 bit samples are precise enough not to need a dither
+    Sint32* const out = (Sint32*) _out;
+    for (int i = 0; i < nb_samples; i++) {
+      double const x = in[i] * 2147483647.0;
+      out[i] = (Sint32) (x + (x < 0 ? -.5 : .5));
+    }
+  }
+}
+
+// produces "nb_frames" frames of the output of a mixer with a device: they
+// are mixed now, or read from the ring of the render-ahead thread (the
+// callback then never waits for the mixer)
+static void mix_output(NMIX_Mixer* m, float* buffer, int nb_frames) {
+  NMIX_RenderAhead* const a = m->ahead;
+  if (a == NULL) {
+    SDL_LockMutex(m->lock);
+    render(m, (Uint8*) buffer, nb_frames * 2 * sizeof(float));
+    SDL_UnlockMutex(m->lock);
+    return;
+  }
+
+  // the thread is late: the missing frames are played as silence
+  int const n = SDL_min((Uint32) nb_frames, ring_fill(&a->ring));
+  ring_read(&a->ring, buffer, n);
+  if (n < nb_frames) {
+    SDL_memset(buffer + 2 * n, 0, (nb_frames - n) * 2 * sizeof(float));
+    SDL_AtomicIncRef(&m->underruns);
+  }
+  SDL_SemPost(a->wake);
+}
+
+// mixes blocks into the ring of a render-ahead state, until it holds
+// target_frames frames. The mixer is locked.
+static void render_ahead(NMIX_Mixer* m, NMIX_RenderAhead* a) {
+  while (ring_fill(&a->ring) + a->block_frames <= (Uint32) a->target_frames) {
+    render(m, (Uint8*) a->block, a->block_frames * 2 * sizeof(float));
+    ring_write(&a->ring, a->block, a->block_frames);
+  }
+}
+
+// the render-ahead thread: it refills the ring each time the callback
+// reads it
+static int SDLCALL render_thread(void* data) {
+  NMIX_RenderAhead* const a = (NMIX_RenderAhead*) data;
+  NMIX_Mixer* const m = a->mixer;
+  Uint32 const timeout = a->block_frames * 1000 / m->spec.freq + 1;
+
+  SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH);
+  while (SDL_AtomicGet(&a->running)) {
+    SDL_LockMutex(m->lock);
+    // the underruns counted by the callback are sent from here, as the
+    // events are only sent with the mixer locked
+    int const underruns = SDL_AtomicGet(&m->underruns);
+    if (underruns != a->reported_underruns) {
+      a->reported_underruns = underruns;
+      push_event(m, NMIX_EVENT_UNDERRUN, NULL);
+    }
+    render_ahead(m, a);
+    SDL_UnlockMutex(m->lock);
+    SDL_SemWaitTimeout(a->wake, timeout);
+  }
+  return 0;
+}
+
+// frees a render-ahead state
+static void free_render_ahead(NMIX_RenderAhead* a) {
+  if (a->wake != NULL) {
+    SDL_DestroySemaphore(a->wake);
+  }
+  SDL_free(a->block);
+  SDL_free(a->ring.frames);
+  SDL_free(a);
+}
+
+// the callback used by SDL_nmix to mix all the sources together
+static void SDLCALL nmix_callback(
+    void* userdata, Uint8* buffer, int buffer_size) {
+  NMIX_Mixer* const m = (NMIX_Mixer*) userdata;
+
+  if (m->master_buffer == NULL) {
+    mix_output(m, (float*) buffer, buffer_size / (2 * sizeof(float)));
+  } else {
+    // the device doesn't use floats: the sources are mixed in master_buffer,
+    // then converted to the samples of the device
+    int const sample_size = SDL_AUDIO_BITSIZE(m->device_format) / 8;
+    int const frame_size = sample_size * m->spec.channels;
+    int frames = buffer_size / frame_size;
+    while (frames > 0) {
+      int const n = SDL_min(frames, m->spec.samples);
+      mix_output(m, m->master_buffer, n);
+      convert_output(m, m->master_buffer, buffer, n * m->spec.channels);
+      buffer += n * frame_size;
+      frames -= n;
+    }
+  }
+}
+
+// allocates a mixer and its state, without any audio device
+static NMIX_Mixer* new_mixer(int rate, int samples) {
+  NMIX_Mixer* m = SDL_calloc(1, sizeof(NMIX_Mixer));
+  if (m == NULL) {
+    SDL_OutOfMemory();
+    return NULL;
+  }
+
+  m->lock = SDL_CreateMutex();
+  if (m->lock == NULL) {
+    SDL_free(m);
+    return NULL;
+  }
+
+  // SDL_nmix uses float32 (AUDIO_F32SYS) samples for mixing, and only
+  // supports stereo output
+  m->spec.freq = rate;
+  m->spec.format = AUDIO_F32SYS;
+  m->spec.channels = 2;
+  m->spec.samples = samples;
+  m->spec.size = samples * m->spec.channels * sizeof(float);
+  m->device_format = AUDIO_F32SYS;
+  m->gain = 1.f;
+  m->dither = SDL_TRUE;
+  m->dither_state = 0x9e3779b9;
+
+  m->out_buffer_size = NMIX_SCRATCH_FRAMES * m->spec.channels * sizeof(float);
+  m->out_buffer = SDL_malloc(m->out_buffer_size);
+  m->ramp_buffer = SDL_malloc(m->out_buffer_size);
+  m->pitch_buffer = SDL_malloc(
+      (NMIX_SCRATCH_FRAMES * NMIX_MAX_PITCH + 3) * 2 * sizeof(float));
+  if (m->out_buffer == NULL || m->ramp_buffer == NULL ||
+      m->pitch_buffer == NULL) {
+    SDL_free(m->out_buffer);
+    SDL_free(m->ramp_buffer);
+    SDL_free(m->pitch_buffer);
+    SDL_DestroyMutex(m->lock);
+    SDL_free(m);
+    SDL_OutOfMemory();
+    return NULL;
+  }
+
+  return m;
+}
+
+NMIX_Mixer* NMIX_NewMixer(int rate, int samples) {
+  if (rate <= 0 || samples <= 0) {
+    SDL_SetError("Invalid mixer rate or size.");
+    return NULL;
+  }
+  return new_mixer(rate, samples);
+}
+
+NMIX_Mixer* NMIX_OpenMixer(const char* device, int rate, int samples) {
+  SDL_version linked;
+  SDL_GetVersion(&linked);
+  if (SDL_VERSIONNUM(linked.major, linked.minor, linked.patch) <
+      SDL_VERSIONNUM(2, 0, 7)) {
+    SDL_SetError("SDL_nmix requires SDL 2.0.7 or later.");
+    return NULL;
+  }
+
+  if (!SDL_WasInit(SDL_INIT_AUDIO)) {
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0) {
+      return NULL;
+    }
+  }
+
+  NMIX_Mixer* m = new_mixer(rate, samples);
+  if (m == NULL) {
+    return NULL;
+  }
+
+  SDL_AudioSpec wanted_spec = m->spec;
+  wanted_spec.callback = nmix_callback;
+  wanted_spec.userdata = m;
+
+  // the device is opened in its native format when SDL_nmix can convert to
+  // it, which saves a conversion by SDL (and a copy of every buffer)
+  SDL_AudioSpec obtained;
+  m->device = SDL_OpenAudioDevice(device, 0, &wanted_spec, &obtained,
+      SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_FORMAT_CHANGE);
+  if (m->device != 0 && obtained.format != AUDIO_F32SYS &&
+      obtained.format != AUDIO_S16SYS && obtained.format != AUDIO_S32SYS) {
+    SDL_CloseAudioDevice(m->device);
+    m->device = SDL_OpenAudioDevice(
+        device, 0, &wanted_spec, &obtained, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+  }
+  if (m->device == 0) {
+    NMIX_FreeMixer(m);
+    return NULL;
+  }
+
+  // the mixing is still done with floats, at the rate of the device
+  m->spec.freq = obtained.freq;
+  m->spec.samples = obtained.samples;
+  m->spec.size = obtained.samples * m->spec.channels * sizeof(float);
+  m->device_format = obtained.format;
+  if (m->device_format != AUDIO_F32SYS) {
+    m->master_buffer = SDL_malloc(m->spec.size);
+    if (m->master_buffer == NULL) {
+      NMIX_FreeMixer(m);
+      SDL_OutOfMemory();
+      return NULL;
+    }
+  }
+
+  NMIX_MixerPausePlayback(m, SDL_FALSE);
+
+  return m;
+}
+
+void NMIX_FreeMixer(NMIX_Mixer* m) {
+  if (m == NULL) {
+    return;
+  }
+
+  if (m->ahead != NULL) {
+    NMIX_MixerStopRenderAhead(m);
+  }
+
+  if (m->device != 0) {
+    SDL_PauseAudioDevice(m->device, 1);
+    SDL_CloseAudioDevice(m->device);
+  }
+
+  if (m->capture != NULL) {
+    NMIX_MixerStopCapture(m);
+  }
+
+  // the sources still alive can be freed after the mixer
+  for (int i = 0; i < m->nb_sources; i++) {
+    NMIX_Source* const source = m->sources[i];
+    source->mixer = NULL;
+    source->prev = NULL;
+    source->next = NULL;
+    SDL_AtomicSet(&source->playing, 0);
+  }
+
+  SDL_DestroyMutex(m->lock);
+  SDL_free(m->voices);
+  SDL_free(m->sources);
+  SDL_free(m->in_buffer);
+  SDL_free(m->out_buffer);
+  SDL_free(m->ramp_buffer);
+  SDL_free(m->pitch_buffer);
+  SDL_free(m->master_buffer);
+  free_reverb(m->reverb);
+  SDL_free(m->send_buffer);
+  SDL_free(m->batch.commands);
+  SDL_free(m->committed.commands);
+  SDL_free(m);
+}
+
+void NMIX_LockMixer(NMIX_Mixer* m) {
+  if (m == NULL) {
+    return;
+  }
+  SDL_LockMutex(m->lock);
+}
+
+int NMIX_TryLockMixer(NMIX_Mixer* m) {
+  if (m == NULL) {
+    return -1;
+  }
+  return SDL_TryLockMutex(m->lock);
+}
+
+void NMIX_UnlockMixer(NMIX_Mixer* m) {
+  if (m == NULL) {
+    return;
+  }
+  SDL_UnlockMutex(m->lock);
+}
+
+int NMIX_MixerRender(NMIX_Mixer* m, void* buffer, int buffer_size) {
+  if (m == NULL) {
+    return -1;
+  }
+
+  if (m->device != 0) {
+    SDL_SetError("Cannot render a mixer that plays on an audio device.");
+    return -1;
+  }
+
+  SDL_LockMutex(m->lock);
+  render(m, (Uint8*) buffer, buffer_size);
+  SDL_UnlockMutex(m->lock);
+  return 0;
+}
+
+void NMIX_MixerPausePlayback(NMIX_Mixer* m, SDL_bool pause_on) {
+  if (m == NULL || m->device == 0) {
+    return;
+  }
+  SDL_PauseAudioDevice(m->device, pause_on);
+}
+
+float NMIX_MixerGetGain(NMIX_Mixer* m) {
+  if (m == NULL) {
+    return 0;
+  }
+  return m->gain;
+}
+
+void NMIX_MixerSetGain(NMIX_Mixer* m, float gain) {
+  if (m == NULL) {
+    return;
+  }
+  m->gain = clampf(gain, 0, 2);
+}
+
+void NMIX_MixerGetLevels(NMIX_Mixer* m, NMIX_Levels* levels) {
+  if (m == NULL || levels == NULL) {
+    return;
+  }
+  read_levels(&m->meter, levels);
+}
+
+SDL_bool NMIX_MixerGetDither(NMIX_Mixer* m) {
+  if (m == NULL) {
+    return SDL_FALSE;
+  }
+  return m->dither;
+}
+
+void NMIX_MixerSetDither(NMIX_Mixer* m, SDL_bool dither) {
+  if (m == NULL) {
+    return;
+  }
+  m->dither = dither;
+}
+
+int NMIX_MixerStartRenderAhead(NMIX_Mixer* m, int blocks, int block_frames) {
+  if (m == NULL || m->device == 0) {
+    SDL_SetError("Only a mixer with an audio device can render ahead.");
+    return -1;
+  }
+  if (blocks <= 0 || block_frames <= 0) {
+    SDL_SetError("Invalid number or size of blocks.");
+    return -1;
+  }
+  if (m->ahead != NULL) {
+    SDL_SetError("The mixer already renders ahead.");
+    return -1;
+  }
+
+  NMIX_RenderAhead* const a = SDL_calloc(1, sizeof(NMIX_RenderAhead));
+  if (a == NULL) {
+    SDL_OutOfMemory();
+    return -1;
+  }
+  a->mixer = m;
+  a->reported_underruns = SDL_AtomicGet(&m->underruns);
+  a->block_frames = block_frames;
+  a->target_frames = blocks * block_frames;
+  a->block = SDL_malloc(block_frames * 2 * sizeof(float));
+  if (a->block == NULL || init_ring(&a->ring, a->target_frames) != 0) {
+    free_render_ahead(a);
+    SDL_OutOfMemory();
+    return -1;
+  }
+  a->wake = SDL_CreateSemaphore(0);
+  if (a->wake == NULL) {
+    free_render_ahead(a);
+    return -1;
+  }
+
+  // the ring is filled before the callback reads it
+  SDL_LockMutex(m->lock);
+  render_ahead(m, a);
+  SDL_UnlockMutex(m->lock);
+
+  SDL_LockAudioDevice(m->device);
+  m->ahead = a;
+  SDL_UnlockAudioDevice(m->device);
+
+  SDL_AtomicSet(&a->running, 1);
+  a->thread = SDL_CreateThread(render_thread, "SDL_nmix render", a);
+  if (a->thread == NULL) {
+    SDL_LockAudioDevice(m->device);
+    m->ahead = NULL;
+    SDL_UnlockAudioDevice(m->device);
+    free_render_ahead(a);
+    return -1;
+  }
+
+  return 0;
+}
+
+int NMIX_MixerStopRenderAhead(NMIX_Mixer* m) {
+  if (m == NULL || m->ahead == NULL) {
+    SDL_SetError("The mixer doesn't render ahead.");
+    return -1;
+  }
+
+  // the callback mixes the next buffers itself: the frames left in the ring
+  // are dropped
+  NMIX_RenderAhead* const a = m->ahead;
+  SDL_LockAudioDevice(m->device);
+  m->ahead = NULL;
+  SDL_UnlockAudioDevice(m->device);
+
+  SDL_AtomicSet(&a->running, 0);
+  SDL_SemPost(a->wake);
+  SDL_WaitThread(a->thread, NULL);
+  free_render_ahead(a);
+  return 0;
+}
+
+int NMIX_MixerGetRenderAheadFill(NMIX_Mixer* m) {
+  if (m == NULL) {
+    return 0;
+  }
+
+  SDL_LockAudioDevice(m->device);
+  int const fill = m->ahead != NULL ? (int) ring_fill(&m->ahead->ring) : 0;
+  SDL_UnlockAudioDevice(m->device);
+  return fill;
+}
+
+int NMIX_MixerGetUnderruns(NMIX_Mixer* m) {
+  if (m == NULL) {
+    return 0;
+  }
+  return SDL_AtomicGet(&m->underruns);
+}
+
+int NMIX_MixerStartCapture(NMIX_Mixer* m, SDL_RWops* dst,
+    NMIX_CaptureFormat format, int freedst) {
+  if (m == NULL || dst == NULL) {
+    SDL_SetError("Invalid capture destination.");
+    return -1;
+  }
+  if (m->capture != NULL) {
+    SDL_SetError("The mixer is already captured.");
+    return -1;
+  }
+
+  NMIX_Capture* const c = SDL_calloc(1, sizeof(NMIX_Capture));
+  if (c == NULL) {
+    SDL_OutOfMemory();
+    return -1;
+  }
+  c->dst = dst;
+  c->freedst = freedst;
+  c->format = format;
+
+  // the ring holds about a second of audio
+  if (init_ring(&c->ring, m->spec.freq) != 0) {
+    SDL_free(c);
+    return -1;
+  }
+
+  if (format == NMIX_CAPTURE_WAV) {
+    c->header_pos = SDL_RWtell(dst);
+    if (write_wav_header(dst, m->spec.freq, 0) != 0) {
+      SDL_free(c->ring.frames);
+      SDL_free(c);
+      return -1;
+    }
+  }
+
+  SDL_AtomicSet(&c->running, 1);
+  c->thread = SDL_CreateThread(capture_thread, "SDL_nmix capture", c);
+  if (c->thread == NULL) {
+    SDL_free(c->ring.frames);
+    SDL_free(c);
+    return -1;
+  }
+
+  SDL_LockMutex(m->lock);
+  m->capture = c;
+  SDL_UnlockMutex(m->lock);
+
+  return 0;
+}
+
+int NMIX_MixerStopCapture(NMIX_Mixer* m) {
+  if (m == NULL) {
+    return -1;
+  }
+
+  SDL_LockMutex(m->lock);
+  NMIX_Capture* const c = m->capture;
+  m->capture = NULL;
+  SDL_UnlockMutex(m->lock);
+
+  if (c == NULL) {
+    SDL_SetError("The mixer is not captured.");
+    return -1;
+  }
+
+  // the writer exits once the ring is drained
+  SDL_AtomicSet(&c->running, 0);
+  SDL_WaitThread(c->thread, NULL);
+
+  // the sizes of the WAV header are known now
+  int failed = SDL_AtomicGet(&c->failed);
+  if (c->format == NMIX_CAPTURE_WAV && !failed) {
+    Sint64 const end = SDL_RWtell(c->dst);
+    if (SDL_RWseek(c->dst, c->header_pos, RW_SEEK_SET) < 0 ||
+        write_wav_header(c->dst, m->spec.freq, c->data_size) != 0 ||
+        SDL_RWseek(c->dst, end, RW_SEEK_SET) < 0) {
+      failed = 1;
+    }
+  }
+
+  if (c->freedst && SDL_RWclose(c->dst) != 0) {
+    failed = 1;
+  }
+  SDL_free(c->ring.frames);
+  SDL_free(c);
+
+  if (failed) {
+    SDL_SetError("Error while writing the capture.");
+    return -1;
+  }
+  return 0;
+}
+
+int NMIX_MixerGetCaptureDropped(NMIX_Mixer* m) {
+  if (m == NULL) {
+    return 0;
+  }
+
+  SDL_LockMutex(m->lock);
+  int const dropped =
+      m->capture != NULL ? SDL_AtomicGet(&m->capture->dropped) : 0;
+  SDL_UnlockMutex(m->lock);
+  return dropped;
+}
+
+SDL_AudioSpec* NMIX_MixerGetAudioSpec(NMIX_Mixer* m) {
+  if (m == NULL) {
+    return NULL;
+  }
+  return &m->spec;
+}
+
+SDL_AudioDeviceID NMIX_MixerGetAudioDevice(NMIX_Mixer* m) {
+  if (m == NULL) {
+    return 0;
+  }
+  return m->device;
+}
+
+Uint64 NMIX_MixerGetTime(NMIX_Mixer* m) {
+  if (m == NULL) {
+    return 0;
+  }
+
+  // a 64 bits read is not atomic on every platform
+  SDL_LockMutex(m->lock);
+  Uint64 time = m->time;
+  SDL_UnlockMutex(m->lock);
+  return time;
+}
+
+void NMIX_MixerBeginBatch(NMIX_Mixer* m) {
+  if (m == NULL) {
+    return;
+  }
+  m->batch.count = 0;
+  m->batching = SDL_TRUE;
+}
+
+int NMIX_MixerCommitBatch(NMIX_Mixer* m) {
+  if (m == NULL) {
+    return -1;
+  }
+
+  if (!m->batching) {
+    SDL_SetError("no batch to commit");
+    return -1;
+  }
+  m->batching = SDL_FALSE;
+
+  // the whole batch is handed to the audio thread with a single lock
+  SDL_LockMutex(m->lock);
+  int result =
+      reserve_commands(&m->committed, m->committed.count + m->batch.count);
+  if (result == 0) {
+    SDL_memcpy(m->committed.commands + m->committed.count, m->batch.commands,
+        m->batch.count * sizeof(NMIX_Command));
+    m->committed.count += m->batch.count;
+  }
+  SDL_UnlockMutex(m->lock);
+
+  m->batch.count = 0;
+  return result;
+}
+
+int NMIX_MixerSetFilter(
+    NMIX_Mixer* m, NMIX_FilterType type, float cutoff, float q) {
+  if (m == NULL) {
+    return -1;
+  }
+
+  if (q <= 0) {
+    SDL_SetError("Invalid filter quality factor.");
+    return -1;
+  }
+
+  SDL_LockMutex(m->lock);
+  set_filter(&m->filter, type, cutoff, q, m->spec.freq);
+  SDL_UnlockMutex(m->lock);
+  return 0;
+}
+
+int NMIX_MixerSetReverb(
+    NMIX_Mixer* m, const float* ir, int frames, Uint8 channels) {
+  if (m == NULL) {
+    return -1;
+  }
+
+  // the reverb is prepared without locking the mixer, the FFT of a long
+  // impulse response taking some time
+  NMIX_Reverb* reverb = NULL;
+  float* send_buffer = NULL;
+  if (ir != NULL) {
+    if (frames <= 0 || (channels != 1 && channels != 2)) {
+      SDL_SetError("Invalid impulse response.");
+      return -1;
+    }
+    reverb = new_reverb(ir, frames, channels);
+    if (reverb == NULL) {
+      return -1;
+    }
+    send_buffer = SDL_malloc(m->spec.samples * sizeof(float));
+    if (send_buffer == NULL) {
+      free_reverb(reverb);
+      SDL_OutOfMemory();
+      return -1;
+    }
+  }
+
+  SDL_LockMutex(m->lock);
+  NMIX_Reverb* const old_reverb = m->reverb;
+  m->reverb = reverb;
+  if (send_buffer != NULL && m->send_buffer == NULL) {
+    m->send_buffer = send_buffer;
+    m->send_buffer_frames = m->spec.samples;
+    send_buffer = NULL;
+  }
+  SDL_UnlockMutex(m->lock);
+
+  free_reverb(old_reverb);
+  SDL_free(send_buffer);
+  return 0;
+}
+
+float NMIX_MixerGetVirtualThreshold(NMIX_Mixer* m) {
+  if (m == NULL) {
+    return 0;
+  }
+  return m->virtual_threshold;
+}
+
+void NMIX_MixerSetVirtualThreshold(NMIX_Mixer* m, float gain) {
+  if (m == NULL) {
+    return;
+  }
+  m->virtual_threshold = clampf(gain, 0, 2);
+}
+
+int NMIX_MixerGetMaxVoices(NMIX_Mixer* m) {
+  if (m == NULL) {
+    return 0;
+  }
+  return m->max_voices;
+}
+
+void NMIX_MixerSetMaxVoices(NMIX_Mixer* m, int count) {
+  if (m == NULL) {
+    return;
+  }
+  m->max_voices = count < 0 ? 0 : count;
+}
+
+int NMIX_OpenAudio(const char* device, int rate, int samples) {
+  if (default_mixer != NULL) {
+    SDL_SetError("NMIX device is already opened.");
+    return -1;
+  }
+
+  default_mixer = NMIX_OpenMixer(device, rate, samples);
+  if (default_mixer == NULL) {
+    return -1;
+  }
+
+  return 0;
+}
+
+int NMIX_CloseAudio(void) {
+  if (default_mixer == NULL) {
+    SDL_SetError("NMIX device is already closed.");
+    return -1;
+  }
+
+  NMIX_FreeMixer(default_mixer);
+  default_mixer = NULL;
+  return 0;
+}
+
+NMIX_Mixer* NMIX_GetDefaultMixer(void) {
+  return default_mixer;
+}
+
+void NMIX_PausePlayback(SDL_bool pause_on) {
+  NMIX_MixerPausePlayback(default_mixer, pause_on);
+}
+
+float NMIX_GetMasterGain(void) {
+  return NMIX_MixerGetGain(default_mixer);
+}
+
+void NMIX_SetMasterGain(float gain) {
+  NMIX_MixerSetGain(default_mixer, gain);
+}
+
+int NMIX_SetMasterFilter(NMIX_FilterType type, float cutoff, float q) {
+  if (default_mixer == NULL) {
+    SDL_SetError("NMIX device is not opened.");
+    return -1;
+  }
+  return NMIX_MixerSetFilter(default_mixer, type, cutoff, q);
+}
+
+int NMIX_SetReverb(const float* ir, int frames, Uint8 channels) {
+  if (default_mixer == NULL) {
+    SDL_SetError("NMIX device is not opened.");
+    return -1;
+  }
+  return NMIX_MixerSetReverb(default_mixer, ir, frames, channels);
+}
+
+void NMIX_GetMasterLevels(NMIX_Levels* levels) {
+  NMIX_MixerGetLevels(default_mixer, levels);
+}
+
+SDL_bool NMIX_GetDither(void) {
+  return NMIX_MixerGetDither(default_mixer);
+}
+
+void NMIX_SetDither(SDL_bool dither) {
+  NMIX_MixerSetDither(default_mixer, dither);
+}
+
+int NMIX_StartRenderAhead(int blocks, int block_frames) {
+  if (default_mixer == NULL) {
+    SDL_SetError("NMIX device is not opened.");
+    return -1;
+  }
+  return NMIX_MixerStartRenderAhead(default_mixer, blocks, block_frames);
+}
+
+int NMIX_StopRenderAhead(void) {
+  if (default_mixer == NULL) {
+    SDL_SetError("NMIX device is not opened.");
+    return -1;
+  }
+  return NMIX_MixerStopRenderAhead(default_mixer);
+}
+
+int NMIX_GetRenderAheadFill(void) {
+  return NMIX_MixerGetRenderAheadFill(default_mixer);
+}
+
+int NMIX_GetUnderruns(void) {
+  return NMIX_MixerGetUnderruns(default_mixer);
+}
+
+int NMIX_StartCapture(
+    SDL_RWops* dst, NMIX_CaptureFormat format, int freedst) {
+  if (default_mixer == NULL) {
+    SDL_SetError("NMIX device is not opened.");
+    return -1;
+  }
+  return NMIX_MixerStartCapture(default_mixer, dst, format, freedst);
+}
+
+int NMIX_StopCapture(void) {
+  if (default_mixer == NULL) {
+    SDL_SetError("NMIX device is not opened.");
+    return -1;
+  }
+  return NMIX_MixerStopCapture(default_mixer);
+}
+
+int NMIX_GetCaptureDropped(void) {
+  return NMIX_MixerGetCaptureDropped(default_mixer);
+}
+
+SDL_AudioSpec* NMIX_GetAudioSpec(void) {
+  return NMIX_MixerGetAudioSpec(default_mixer);
+}
+
+SDL_AudioDeviceID NMIX_GetAudioDevice(void) {
+  return NMIX_MixerGetAudioDevice(default_mixer);
+}
+
+Uint64 NMIX_GetTime(void) {
+  return NMIX_MixerGetTime(default_mixer);
+}
+
+void NMIX_BeginBatch(void) {
+  NMIX_MixerBeginBatch(default_mixer);
+}
+
+int NMIX_CommitBatch(void) {
+  if (default_mixer == NULL) {
+    SDL_SetError("NMIX device is not opened.");
+    return -1;
+  }
+  return NMIX_MixerCommitBatch(default_mixer);
+}
+
+float NMIX_GetVirtualThreshold(void) {
+  return NMIX_MixerGetVirtualThreshold(default_mixer);
+}
+
+void NMIX_SetVirtualThreshold(float gain) {
+  NMIX_MixerSetVirtualThreshold(default_mixer, gain);
+}
+
+int NMIX_GetMaxVoices(void) {
+  return NMIX_MixerGetMaxVoices(default_mixer);
+}
+
+void NMIX_SetMaxVoices(int count) {
+  NMIX_MixerSetMaxVoices(default_mixer, count);
+}
+
+// grows the buffers of a mixer so that they can be used by a new source
+// (the mixer must be locked)
+static int reserve_source(NMIX_Mixer* m, NMIX_Source* source) {
+  // making sure that every source fits in the array used to sort the voices
+  if (m->nb_sources + 1 > m->voices_capacity) {
+    int capacity = m->voices_capacity > 0 ? m->voices_capacity * 2 : 64;
+    NMIX_Source** v = SDL_realloc(m->voices, capacity * sizeof(NMIX_Source*));
+    if (v == NULL) {
+      SDL_OutOfMemory();
+      return -1;
+    }
+    m->voices = v;
+    v = SDL_realloc(m->sources, capacity * sizeof(NMIX_Source*));
+    if (v == NULL) {
+      SDL_OutOfMemory();
+      return -1;
+    }
+    m->sources = v;
+    m->voices_capacity = capacity;
+  }
+
+  // and that the data of its callback fits in the scratch buffer (sources
+  // lending their data don't use it)
+  if (source->lend == NULL && source->in_buffer_size > m->in_buffer_size) {
+    void* in_buffer = SDL_realloc(m->in_buffer, source->in_buffer_size);
+    if (in_buffer == NULL) {
+      SDL_OutOfMemory();
+      return -1;
+    }
+    m->in_buffer = in_buffer;
+    m->in_buffer_size = source->in_buffer_size;
+  }
+
+  m->sources[m->nb_sources++] = source;
+  return 0;
+}
+
+NMIX_Source* NMIX_NewSource(SDL_AudioFormat format, Uint8 channels, int rate,
+    NMIX_SourceCallback callback, void* userdata) {
+  if (default_mixer == NULL) {
+    SDL_SetError("Please open NMIX device before creating sources.");
+    return NULL;
+  }
+
+  return NMIX_NewMixerSource(
+      default_mixer, format, channels, rate, callback, userdata);
+}
+
+NMIX_Source* NMIX_NewLendSource(SDL_AudioFormat format, Uint8 channels,
+    int rate, NMIX_SourceLendCallback lend, void* userdata) {
+  if (default_mixer == NULL) {
+    SDL_SetError("Please open NMIX device before creating sources.");
+    return NULL;
+  }
+
+  return NMIX_NewMixerLendSource(
+      default_mixer, format, channels, rate, lend, userdata);
+}
+
+// creates a source retrieving its data either with "callback" or "lend"
+static NMIX_Source* new_source(NMIX_Mixer* m, SDL_AudioFormat format,
+    Uint8 channels, int rate, NMIX_SourceCallback callback,
+    NMIX_SourceLendCallback lend, void* userdata) {
+  if (m == NULL) {
+    SDL_SetError("Please create a mixer before creating sources.");
+    return NULL;
+  }
+
+  NMIX_Source* source = SDL_malloc(sizeof(NMIX_Source));
+  if (source == NULL) {
+    SDL_OutOfMemory();
+    return NULL;
+  }
+
+  source->mixer = m;
+  source->format = format;
+  source->channels = channels;
+  source->rate = rate;
+  source->pan = 0.f;
+  source->gain = 1.f;
+  NMIX_Ramp const ramp = {0.f, 0.f, 0, 0, NMIX_FADE_LINEAR, SDL_FALSE};
+  source->pan_ramp = ramp;
+  source->gain_ramp = ramp;
+  source->fade = ramp;
+  set_ramp(&source->gain_ramp, 1.f);
+  set_ramp(&source->fade, 1.f);
+  SDL_zero(source->filter);
+  source->reverb_send = 0.f;
+  source->pitch = 1.f;
+  source->pitch_phase = 0;
+  source->pitch_buffered = 0;
+  SDL_zeroa(source->pitch_frames);
+  SDL_zero(source->meter);
+  SDL_AtomicSet(&source->playing, 0);
+  source->callback = callback;
+  source->lend = lend;
+  source->seek = NULL;
+  source->skip = NULL;
+  source->userdata = userdata;
+  source->oscillator = NULL;
+  source->eof = SDL_FALSE;
+  source->start_time = 0;
+  source->stop_time = SDL_MAX_UINT64;
+  source->priority = 1.f;
+  source->score = 0.f;
+  source->virtualized = SDL_FALSE;
+  source->skip_credit = 0;
+  source->skip_remainder = 0;
+
+  // the callback is asked for the samples that correspond to (at most)
+  // NMIX_CHUNK_FRAMES frames of the mixer: the source itself holds no
+  // buffer, the data is received in the scratch buffer of the mixer (or
+  // lent by the source).
+  int chunk_frames = SDL_min(m->spec.samples, NMIX_CHUNK_FRAMES);
+  int in_nb_samples = source->rate * chunk_frames / m->spec.freq;
+  if (in_nb_samples < 1) {
+    in_nb_samples = 1;
+  }
+  source->in_buffer_size =
+      in_nb_samples * source->channels * SDL_AUDIO_SAMPLELEN(source->format);
+
+  // the mixer reads mono and stereo, float and Sint16 data directly: the
+  // other sources are converted by SDL_AudioStream
+  source->stream = NULL;
+  if (source->rate != m->spec.freq ||
+      (source->format != AUDIO_F32SYS && source->format != AUDIO_S16SYS) ||
+      (source->channels != 1 && source->channels != 2)) {
+    source->stream = SDL_NewAudioStream(source->format, source->channels,
+        source->rate, m->spec.format, m->spec.channels, m->spec.freq);
+    if (source->stream == NULL) {
+      SDL_free(source);
+      return NULL;
+    }
+  }
+
+  source->prev = NULL;
+  source->next = NULL;
+
+  SDL_LockMutex(m->lock);
+  int result = reserve_source(m, source);
+  SDL_UnlockMutex(m->lock);
+  if (result != 0) {
+    if (source->stream != NULL) {
+      SDL_FreeAudioStream(source->stream);
+    }
+    SDL_free(source);
+    return NULL;
+  }
+
+  return source;
+}
+
+NMIX_Source* NMIX_NewMixerSource(NMIX_Mixer* m, SDL_AudioFormat format,
+    Uint8 channels, int rate, NMIX_SourceCallback callback, void* userdata) {
+  return new_source(m, format, channels, rate, callback, NULL, userdata);
+}
+
+NMIX_Source* NMIX_NewMixerLendSource(NMIX_Mixer* m, SDL_AudioFormat format,
+    Uint8 channels, int rate, NMIX_SourceLendCallback lend, void* userdata) {
+  return new_source(m, format, channels, rate, NULL, lend, userdata);
+}
+
+// creates a source generating "waveform", with a copy of "table" (of "size"
+// samples) if it's a wavetable
+static NMIX_Source* new_oscillator(NMIX_Mixer* m, NMIX_Waveform waveform,
+    float frequency, const float* table, int size) {
+  if (m == NULL) {
+    SDL_SetError("Please create a mixer before creating sources.");
+    return NULL;
+  }
+  if (!(frequency >= 0)) {
+    SDL_SetError("Invalid oscillator frequency.");
+    return NULL;
+  }
+
+  // the table is stored after the oscillator, followed by its first sample
+  // so that the interpolation doesn't wrap around
+  int table_bits = 0;
+  if (waveform == NMIX_WAVE_TABLE) {
+    while ((1 << table_bits) < size) {
+      table_bits++;
+    }
+  }
+  NMIX_Oscillator* o = SDL_malloc(sizeof(NMIX_Oscillator) +
+                                  (size + 1) * sizeof(float));
+  if (o == NULL) {
+    SDL_OutOfMemory();
+    return NULL;
+  }
+  o->waveform = waveform;
+  o->frequency = frequency;
+  o->phase = 0;
+  o->noise = 0x9E3779B9u;
+  o->table_bits = table_bits;
+  o->table = NULL;
+  if (waveform == NMIX_WAVE_TABLE) {
+    o->table = (float*) (o + 1);
+    SDL_memcpy(o->table, table, size * sizeof(float));
+    o->table[size] = table[0];
+  }
+
+  // the oscillator is a mono float source at the mixer rate, mixed without
+  // conversion
+  NMIX_Source* source =
+      new_source(m, AUDIO_F32SYS, 1, m->spec.freq, NULL, NULL, NULL);
+  if (source == NULL) {
+    SDL_free(o);
+    return NULL;
+  }
+  source->oscillator = o;
+
+  return source;
+}
+
+NMIX_Source* NMIX_NewOscillator(NMIX_Waveform waveform, float frequency) {
+  if (default_mixer == NULL) {
+    SDL_SetError("Please open NMIX device before creating sources.");
+    return NULL;
+  }
+
+  return NMIX_NewMixerOscillator(default_mixer, waveform, frequency);
+}
+
+NMIX_Source* NMIX_NewWavetable(
+    const float* table, int size, float frequency) {
+  if (default_mixer == NULL) {
+    SDL_SetError("Please open NMIX device before creating sources.");
+    return NULL;
+  }
+
+  return NMIX_NewMixerWavetable(default_mixer, table, size, frequency);
+}
+
+NMIX_Source* NMIX_NewMixerOscillator(
+    NMIX_Mixer* m, NMIX_Waveform waveform, float frequency) {
+  if (waveform < NMIX_WAVE_SINE || waveform >= NMIX_WAVE_TABLE) {
+    SDL_SetError("Invalid oscillator waveform.");
+    return NULL;
+  }
+
+  return new_oscillator(m, waveform, frequency, NULL, 0);
+}
+
+NMIX_Source* NMIX_NewMixerWavetable(
+    NMIX_Mixer* m, const float* table, int size, float frequency) {
+  if (table == NULL || size < 2 || size > NMIX_MAX_WAVETABLE ||
+      (size & (size - 1)) != 0) {
+    SDL_SetError("Invalid wavetable size (a power of two up to %d).",
+        NMIX_MAX_WAVETABLE);
+    return NULL;
+  }
+
+  return new_oscillator(m, NMIX_WAVE_TABLE, frequency, table, size);
+}
+
+void NMIX_FreeSource(NMIX_Source* source) {
+  if (source == NULL) {
+    return;
+  }
+
+  // a source detached by NMIX_FreeMixer is only freed
+  NMIX_Mixer* const m = source->mixer;
+  if (m != NULL) {
+    SDL_LockMutex(m->lock);
+    pause_source(source);
+
+    // the pending changes must not refer to a freed source
+    purge_commands(&m->batch, source);
+    purge_commands(&m->committed, source);
+    for (int i = 0; i < m->nb_sources; i++) {
+      if (m->sources[i] == source) {
+        m->sources[i] = m->sources[m->nb_sources - 1];
+        break;
+      }
+    }
+    m->nb_sources--;
+  }
+
+  if (source->stream != NULL) {
+    SDL_FreeAudioStream(source->stream);
+  }
+  SDL_free(source->oscillator);
+  SDL_free(source);
+  if (m != NULL) {
+    SDL_UnlockMutex(m->lock);
+  }
+}
+
+int NMIX_Play(NMIX_Source* source) {
+  return NMIX_PlayAt(source, 0);
+}
+
+int NMIX_PlayAt(NMIX_Source* source, Uint64 time) {
+  if (source == NULL) {
+    return -1;
+  }
+
+  NMIX_Mixer* const m = source->mixer;
+  if (m->batching) {
+    NMIX_Command command = {NMIX_COMMAND_PLAY, source, {.time = time}};
+    return record_command(m, &command);
+  }
+
+  SDL_LockMutex(m->lock);
+  int result = play_source(source, time);
+  SDL_UnlockMutex(m->lock);
+
+  return result;
+}
+
+void NMIX_Pause(NMIX_Source* source) {
+  if (source == NULL) {
+    return;
+  }
+
+  NMIX_Mixer* const m = source->mixer;
+  if (m->batching) {
+    NMIX_Command command = {NMIX_COMMAND_PAUSE, source, {0}};
+    record_command(m, &command);
+    return;
+  }
+
+  SDL_LockMutex(m->lock);
+  pause_source(source);
+  SDL_UnlockMutex(m->lock);
+}
+
+void NMIX_StopAt(NMIX_Source* source, Uint64 time) {
+  if (source == NULL) {
+    return;
+  }
+
+  NMIX_Mixer* const m = source->mixer;
+  if (m->batching) {
+    NMIX_Command command = {NMIX_COMMAND_STOP_AT, source, {.time = time}};
+    record_command(m, &command);
+    return;
+  }
+
+  SDL_LockMutex(m->lock);
+  source->stop_time = time;
+  SDL_UnlockMutex(m->lock);
+}
+
+SDL_bool NMIX_IsPlaying(NMIX_Source* source) {
+  if (source == NULL) {
+    return SDL_FALSE;
+  }
+  return SDL_AtomicGet(&source->playing) != 0;
+}
+
+float NMIX_GetPan(NMIX_Source* source) {
+  if (source == NULL) {
+    return 0;
+  }
+  return source->pan;
+}
+
+void NMIX_SetPan(NMIX_Source* source, float pan) {
+  if (source == NULL) {
+    return;
+  }
+
+  NMIX_Mixer* const m = source->mixer;
+  if (m->batching) {
+    NMIX_Command command = {
+        NMIX_COMMAND_SET_PAN, source, {.value = clampf(pan, -1, 1)}};
+    record_command(m, &command);
+    return;
+  }
+
+  SDL_LockMutex(m->lock);
+  set_pan(source, clampf(pan, -1, 1));
+  SDL_UnlockMutex(m->lock);
+}
+
+int NMIX_SweepPan(NMIX_Source* source, float pan, int ms) {
+  if (source == NULL) {
+    return -1;
+  }
+
+  NMIX_Mixer* const m = source->mixer;
+  int const length = ms > 0 ? (Sint64) ms * m->spec.freq / 1000 : 0;
+  pan = clampf(pan, -1, 1);
+  if (m->batching) {
+    NMIX_Command command = {NMIX_COMMAND_SWEEP_PAN, source,
+        {.fade = {pan, length, NMIX_FADE_LINEAR, SDL_FALSE, SDL_FALSE}}};
+    return record_command(m, &command);
+  }
+
+  SDL_LockMutex(m->lock);
+  sweep_pan(source, pan, length);
+  SDL_UnlockMutex(m->lock);
+  return 0;
+}
+
+float NMIX_GetGain(NMIX_Source* source) {
+  if (source == NULL) {
+    return 0;
+  }
+  return source->gain;
+}
+
+void NMIX_SetGain(NMIX_Source* source, float gain) {
+  if (source == NULL) {
+    return;
+  }
+
+  NMIX_Mixer* const m = source->mixer;
+  if (m->batching) {
+    NMIX_Command command = {
+        NMIX_COMMAND_SET_GAIN, source, {.value = clampf(gain, 0, 2)}};
+    record_command(m, &command);
+    return;
+  }
+
+  SDL_LockMutex(m->lock);
+  set_gain(source, clampf(gain, 0, 2));
+  SDL_UnlockMutex(m->lock);
+}
+
+int NMIX_FadeGain(NMIX_Source* source, float gain, int ms,
+    NMIX_FadeCurve curve, SDL_bool stop) {
+  if (source == NULL) {
+    return -1;
+  }
+
+  NMIX_Mixer* const m = source->mixer;
+  int const length = ms > 0 ? (Sint64) ms * m->spec.freq / 1000 : 0;
+  gain = clampf(gain, 0, 2);
+  if (m->batching) {
+    NMIX_Command command = {NMIX_COMMAND_FADE_GAIN, source,
+        {.fade = {gain, length, curve, stop, SDL_FALSE}}};
+    return record_command(m, &command);
+  }
+
+  SDL_LockMutex(m->lock);
+  fade_gain(source, gain, length, curve, stop);
+  SDL_UnlockMutex(m->lock);
+  return 0;
+}
+
+int NMIX_Crossfade(
+    NMIX_Source* from, NMIX_Source* to, int ms, NMIX_FadeCurve curve) {
+  if (from == NULL && to == NULL) {
+    SDL_SetError("no source to crossfade");
+    return -1;
+  }
+  if (from != NULL && to != NULL && from->mixer != to->mixer) {
+    SDL_SetError("cannot crossfade sources played by different mixers");
+    return -1;
+  }
+
+  NMIX_Mixer* const m = from != NULL ? from->mixer : to->mixer;
+  int const length = ms > 0 ? (Sint64) ms * m->spec.freq / 1000 : 0;
+
+  // both fades are applied together, so that they start on the same frame
+  NMIX_Command commands[2];
+  int count = 0;
+  if (from != NULL) {
+    NMIX_Command const command = {NMIX_COMMAND_FADE, from,
+        {.fade = {0.f, length, curve, SDL_TRUE, SDL_FALSE}}};
+    commands[count++] = command;
+  }
+  if (to != NULL) {
+    NMIX_Command const command = {NMIX_COMMAND_FADE, to,
+        {.fade = {1.f, length, curve, SDL_FALSE, SDL_TRUE}}};
+    commands[count++] = command;
+  }
+
+  if (m->batching) {
+    for (int i = 0; i < count; i++) {
+      if (record_command(m, &commands[i]) != 0) {
+        return -1;
+      }
+    }
+    return 0;
+  }
+
+  SDL_LockMutex(m->lock);
+  for (int i = 0; i < count; i++) {
+    apply_command(&commands[i]);
+  }
+  SDL_UnlockMutex(m->lock);
+  return 0;
+}
+
+int NMIX_SetFilter(
+    NMIX_Source* source, NMIX_FilterType type, float cutoff, float q) {
+  if (source == NULL) {
+    return -1;
+  }
+
+  if (q <= 0) {
+    SDL_SetError("Invalid filter quality factor.");
+    return -1;
+  }
+
+  NMIX_Mixer* const m = source->mixer;
+  if (m->batching) {
+    NMIX_Command command = {NMIX_COMMAND_SET_FILTER, source,
+        {.filter = {type, cutoff, q}}};
+    return record_command(m, &command);
+  }
+
+  SDL_LockMutex(m->lock);
+  set_filter(&source->filter, type, cutoff, q, m->spec.freq);
+  SDL_UnlockMutex(m->lock);
+  return 0;
+}
+
+float NMIX_GetReverbSend(NMIX_Source* source) {
+  if (source == NULL) {
+    return 0;
+  }
+  return source->reverb_send;
+}
+
+void NMIX_SetReverbSend(NMIX_Source* source, float level) {
+  if (source == NULL) {
+    return;
+  }
+
+  NMIX_Mixer* const m = source->mixer;
+  if (m->batching) {
+    NMIX_Command command = {
+        NMIX_COMMAND_SET_REVERB_SEND, source, {.value = clampf(level, 0, 2)}};
+    record_command(m, &command);
+    return;
+  }
+
+  SDL_LockMutex(m->lock);
+  source->reverb_send = clampf(level, 0, 2);
+  SDL_UnlockMutex(m->lock);
+}
+
+float NMIX_GetPitch(NMIX_Source* source) {
+  if (source == NULL) {
+    return 0;
+  }
+  return source->pitch;
+}
+
+void NMIX_SetPitch(NMIX_Source* source, float pitch) {
+  if (source == NULL) {
+    return;
+  }
+
+  NMIX_Mixer* const m = source->mixer;
+  pitch = clampf(pitch, NMIX_MIN_PITCH, NMIX_MAX_PITCH);
+  if (m->batching) {
+    NMIX_Command command = {NMIX_COMMAND_SET_PITCH, source, {.value = pitch}};
+    record_command(m, &command);
+    return;
+  }
+
+  SDL_LockMutex(m->lock);
+  source->pitch = pitch;
+  SDL_UnlockMutex(m->lock);
+}
+
+float NMIX_GetFrequency(NMIX_Source* source) {
+  if (source == NULL || source->oscillator == NULL) {
+    return 0;
+  }
+  return source->oscillator->frequency;
+}
+
+void NMIX_SetFrequency(NMIX_Source* source, float frequency) {
+  if (source == NULL || source->oscillator == NULL || !(frequency >= 0)) {
+    return;
+  }
+
+  NMIX_Mixer* const m = source->mixer;
+  if (m->batching) {
+    NMIX_Command command = {
+        NMIX_COMMAND_SET_FREQUENCY, source, {.value = frequency}};
+    record_command(m, &command);
+    return;
+  }
+
+  SDL_LockMutex(m->lock);
+  source->oscillator->frequency = frequency;
+  SDL_UnlockMutex(m->lock);
+}
+
+// computes the gains, pannings (for the linear pan law of the mixer) and
+// pitches of "count" emitters of a batch, starting at "first": the loop
+// only does arithmetic on arrays, so that compilers can vectorize it
+static void compute_emitters(const NMIX_Listener* listener,
+    const float* right, const NMIX_EmitterBatch* batch, int first, int count,
+    float* gains, float* pans, float* pitches) {
+  float const lx = listener->position[0];
+  float const ly = listener->position[1];
+  float const lz = listener->position[2];
+  float const min_distance = batch->min_distance;
+  float const max_distance = batch->max_distance;
+  float const factor = batch->rolloff_factor;
+
+  for (int i = 0; i < count; i++) {
+    float const dx = batch->x[first + i] - lx;
+    float const dy = batch->y[first + i] - ly;
+    float const dz = batch->z[first + i] - lz;
+    float const distance = (float) SDL_sqrt(dx * dx + dy * dy + dz * dz);
+    float const d = clampf(distance, min_distance, max_distance);
+
+    float attenuation;
+    switch (batch->rolloff) {
+    case NMIX_ROLLOFF_LINEAR:
+      attenuation = 1 - factor * (d - min_distance) /
+                            (max_distance - min_distance);
+      break;
+    case NMIX_ROLLOFF_EXPONENTIAL:
+      attenuation = (float) SDL_pow(d / min_distance, -factor);
+      break;
+    default:
+      attenuation = min_distance / (min_distance + factor * (d - min_distance));
+      break;
+    }
+    float const gain = batch->gains != NULL ? batch->gains[first + i] : 1.f;
+    attenuation = distance > max_distance ? 0 : clampf(attenuation, 0, 1);
+
+    // equal-power panning from the position on the right axis, the center
+    // giving the same gains (1/2) as the linear pan law
+    float const x = distance > 0 ? (dx * right[0] + dy * right[1] +
+                                       dz * right[2]) /
+                                       distance
+                                 : 0;
+    float const angle = (clampf(x, -1, 1) + 1) * (float) M_PI / 4;
+    float const left_gain = (float) SDL_cos(angle) * 0.70710678f;
+    float const right_gain = (float) SDL_sin(angle) * 0.70710678f;
+    gains[i] = clampf(gain * attenuation * (left_gain + right_gain), 0, 2);
+    pans[i] = (right_gain - left_gain) / (left_gain + right_gain);
+    pitches[i] = 1.f;
+  }
+
+  if (batch->speed_of_sound <= 0 || batch->vx == NULL || batch->vy == NULL ||
+      batch->vz == NULL) {
+    return;
+  }
+
+  // Doppler effect, from the velocities of the listener and of the emitter
+  // toward each other (limited to half the speed of sound)
+  float const c = batch->speed_of_sound;
+  for (int i = 0; i < count; i++) {
+    float const dx = batch->x[first + i] - lx;
+    float const dy = batch->y[first + i] - ly;
+    float const dz = batch->z[first + i] - lz;
+    float const distance = (float) SDL_sqrt(dx * dx + dy * dy + dz * dz);
+    if (distance <= 0) {
+      continue;
+    }
+    float const vl = -(dx * listener->velocity[0] + dy * listener->velocity[1] +
+                         dz * listener->velocity[2]) /
+                     distance;
+    float const ve = -(dx * batch->vx[first + i] + dy * batch->vy[first + i] +
+                         dz * batch->vz[first + i]) /
+                     distance;
+    float const pitch = (c - SDL_min(vl, c / 2)) / (c - SDL_min(ve, c / 2));
+    pitches[i] = clampf(pitch, NMIX_MIN_PITCH, NMIX_MAX_PITCH);
+  }
+}
+
+int NMIX_UpdateEmitters(
+    const NMIX_Listener* listener, const NMIX_EmitterBatch* batch) {
+  if (listener == NULL || batch == NULL) {
+    return -1;
+  }
+  if (batch->count <= 0) {
+    return 0;
+  }
+  if (batch->min_distance <= 0 ||
+      batch->max_distance <= batch->min_distance) {
+    SDL_SetError("Invalid emitter distances.");
+    return -1;
+  }
+
+  // the right axis of the listener
+  const float* const f = listener->forward;
+  const float* const u = listener->up;
+  float right[3] = {f[1] * u[2] - f[2] * u[1], f[2] * u[0] - f[0] * u[2],
+      f[0] * u[1] - f[1] * u[0]};
+  float const norm = (float) SDL_sqrt(
+      right[0] * right[0] + right[1] * right[1] + right[2] * right[2]);
+  if (norm <= 0) {
+    SDL_SetError("Invalid listener orientation.");
+    return -1;
+  }
+  for (int i = 0; i < 3; i++) {
+    right[i] /= norm;
+  }
+
+  SDL_bool const doppler = batch->speed_of_sound > 0 && batch->vx != NULL &&
+                           batch->vy != NULL && batch->vz != NULL;
+
+  // the changes are applied with a single lock, or recorded in the batch
+  NMIX_Mixer* const m = batch->sources[0]->mixer;
+  if (!m->batching) {
+    SDL_LockMutex(m->lock);
+  }
+
+  int result = 0;
+  for (int first = 0; first < batch->count; first += NMIX_EMITTER_BLOCK) {
+    int const count = SDL_min(batch->count - first, NMIX_EMITTER_BLOCK);
+    float gains[NMIX_EMITTER_BLOCK];
+    float pans[NMIX_EMITTER_BLOCK];
+    float pitches[NMIX_EMITTER_BLOCK];
+    compute_emitters(
+        listener, right, batch, first, count, gains, pans, pitches);
+
+    for (int i = 0; i < count; i++) {
+      NMIX_Source* const s = batch->sources[first + i];
+      if (s->mixer != m) {
+        SDL_SetError("emitters played by different mixers");
+        result = -1;
+        continue;
+      }
+
+      // the emitters culled (or muted) are only muted once
+      if (gains[i] == 0 && s->gain == 0) {
+        continue;
+      }
+
+      if (!m->batching) {
+        set_gain(s, gains[i]);
+        if (gains[i] > 0) {
+          set_pan(s, pans[i]);
+          if (doppler) {
+            s->pitch = pitches[i];
+          }
+        }
+        continue;
+      }
+
+      NMIX_Command command = {
+          NMIX_COMMAND_SET_GAIN, s, {.value = gains[i]}};
+      if (record_command(m, &command) != 0) {
+        return -1;
+      }
+      if (gains[i] > 0) {
+        command.type = NMIX_COMMAND_SET_PAN;
+        command.arg.value = pans[i];
+        if (record_command(m, &command) != 0) {
+          return -1;
+        }
+        if (doppler) {
+          command.type = NMIX_COMMAND_SET_PITCH;
+          command.arg.value = pitches[i];
+          if (record_command(m, &command) != 0) {
+            return -1;
+          }
+        }
+      }
+    }
+  }
+
+  if (!m->batching) {
+    SDL_UnlockMutex(m->lock);
+  }
+  return result;
+}
+
+int NMIX_SeekSource(NMIX_Source* source, Sint64 frame) {
+  if (source == NULL) {
+    return -1;
+  }
+
+  NMIX_Mixer* const m = source->mixer;
+  if (m->batching) {
+    NMIX_Command command = {NMIX_COMMAND_SEEK, source, {.frame = frame}};
+    return record_command(m, &command);
+  }
+
+  SDL_LockMutex(m->lock);
+  int result = seek_source(source, frame);
+  SDL_UnlockMutex(m->lock);
+
+  return result;
+}
+
+float NMIX_GetPriority(NMIX_Source* source) {
+  if (source == NULL) {
+    return 0;
+  }
+  return source->priority;
+}
+
+void NMIX_SetPriority(NMIX_Source* source, float priority) {
+  if (source == NULL) {
+    return;
+  }
+  source->priority = priority < 0 ? 0 : priority;
+}
+
+SDL_bool NMIX_IsVirtual(NMIX_Source* source) {
+  if (source == NULL) {
+    return SDL_FALSE;
+  }
+  return NMIX_IsPlaying(source) && source->virtualized;
+}
+
+int NMIX_MixerPollEvent(NMIX_Mixer* m, NMIX_Event* event) {
+  if (m == NULL || event == NULL) {
+    return 0;
+  }
+
+  NMIX_EventQueue* const q = &m->events;
+  Uint32 const read = (Uint32) SDL_AtomicGet(&q->read_pos);
+  if (read == (Uint32) SDL_AtomicGet(&q->write_pos)) {
+    return 0;
+  }
+  *event = q->events[read & (NMIX_EVENT_QUEUE_SIZE - 1)];
+  SDL_AtomicSet(&q->read_pos, (int) (read + 1));
+  return 1;
+}
+
+int NMIX_PollEvent(NMIX_Event* event) {
+  return NMIX_MixerPollEvent(default_mixer, event);
+}
+
+void NMIX_PushEvent(NMIX_Source* source, NMIX_EventType type) {
+  if (source == NULL) {
+    return;
+  }
+  push_event(source->mixer, type, source);
+}
+
+void NMIX_GetLevels(NMIX_Source* source, NMIX_Levels* levels) {
+  if (source == NULL || levels == NULL) {
     return;
   }
-  source->gain = clampf(gain, 0, 2);
+  read_levels(&source->meter, levels);
 }
@@ -9,17 +9,47 @@
  * development. Features:
 
  * - stereo audio mixer
- * - only two files to copy to your project, under 800 lines of code
+ * - only two files to copy to your project
  * - free and open source under zlib license
  * - cross-platform: tested on macOS, debian, Windows and web (thanks to
  *   emscripten)
  * - a binding to [SDL_sound](https://hg.icculus.org/icculus/SDL_sound/) is
  *   provided, to decode the most usual file formats
- *   (ogg/wav/flac/mp3/mod/xm/it/etc), with seamless looping. The files can be
- *   either preloaded into memory or streamed.
+ *   (ogg/wav/flac/mp3/mod/xm/it/etc), with seamless looping (of the whole
+ *   file or of a loop region, e.g. after an intro). The files can be either
+ *   preloaded into memory or streamed, optionally read ahead by an I/O
+ *   thread so that the decoder never waits for the disk.
  * - automatic audio conversion on the fly
  * - linear panning + gain setting on each source
  * - a global gain setting
+ * - sample-accurate scheduling of sources with a mixer clock
+ * - voice virtualization: inaudible sources keep playing without being mixed
+ * - sample-accurate crossfades between sources (linear or equal-power)
+ * - gain and pan automation (fades and sweeps) computed by the mixer
+ * - low-pass, high-pass and band-pass filters on each source and on the
+ *   master output
+ * - a convolution reverb shared by all the sources, with a send level on
+ *   each source
+ * - pitch (playback speed) setting on each source
+ * - oscillators (sine, square, saw, triangle, noise) and wavetables
+ *   generated by the mixer right into the mix, without callback nor buffer
+ * - 3D positional audio computed by batches of emitters: distance
+ *   attenuation, equal-power panning, Doppler effect and culling
+ * - output in the native sample format of the device (float, 16 or 32 bit),
+ *   with a dither when converting to 16 bit
+ * - peak and RMS meters on each source and on the output, readable from any
+ *   thread
+ * - events (finished, looped, stolen sources, underruns) queued without
+ *   locks, so that the game doesn't poll its sources
+ * - optional render-ahead thread, so that the audio callback only copies
+ *   data mixed in advance
+ * - capture of the output to a WAV or raw file, written by a background
+ *   thread
+ * - sound banks: sounds decoded and converted offline by the nmix_pack
+ *   tool, then mapped in memory so that they play without loading
+ * - parallel loading of preloaded files on all the CPU cores, with loudness
+ *   normalization (ITU-R BS.1770) and trimming of the silence at both ends
+ * - independent mixers, which can also render audio offline
  *
  * The library depends on the SDL (2.0.7+) which you can find
  * [here](https://www.libsdl.org/). Just copy SDL_nmix.c/.h in your project,
@@ -78,6 +108,202 @@
 typedef void(SDLCALL* NMIX_SourceCallback)(
     void* userdata, void* stream, int stream_size);
 
+/**
+ *  This function is called when SDL_nmix needs more data for a source that
+ *  lends its own memory instead of filling a buffer.
+ *
+ *  \param userdata An application-specific parameter saved in
+ *                  the NMIX_Source structure
+ *  \param data Receives a pointer to the audio data.
+ *  \param len The maximum number of bytes the mixer wants.
+ *  \return The number of bytes available at *data (at most len). Returning
+ *          less than len is a short read: the mixer calls the function
+ *          again for the rest. Returning 0 means that the end of the source
+ *          has been reached.
+ *
+ *  The data is owned by the source, and must stay valid until the next call
+ *  of the function (or until the source is freed). The mixer reads it
+ *  without copying it.
+ *
+ *  \sa NMIX_NewLendSource
+ */
+typedef int(SDLCALL* NMIX_SourceLendCallback)(
+    void* userdata, const void** data, int len);
+
+/**
+ *  This function is called when a source needs to change its position.
+ *
+ *  \param userdata An application-specific parameter saved in
+ *                  the NMIX_Source structure
+ *  \param frame The new position, in sample frames from the beginning of
+ *               the source
+ *  \return zero on success, -1 on error.
+ *
+ *  This callback is called with the mixer locked.
+ *
+ *  \sa NMIX_SeekSource
+ */
+typedef int(SDLCALL* NMIX_SourceSeekCallback)(void* userdata, Sint64 frame);
+
+/**
+ *  This function is called when a virtual source needs to advance its
+ *  position without producing audio data.
+ *
+ *  \param userdata An application-specific parameter saved in
+ *                  the NMIX_Source structure
+ *  \param frames The number of sample frames (at the source rate) to skip
+ *  \return The number of frames skipped. Returning less than "frames" means
+ *          that the end of the source has been reached.
+ *
+ *  This callback is called from the audio thread.
+ *
+ *  \sa NMIX_SetVirtualThreshold
+ */
+typedef int(SDLCALL* NMIX_SourceSkipCallback)(void* userdata, int frames);
+
+/**
+ * \struct NMIX_Mixer
+ * \brief Holds the whole state of a mixer: its format, its clock and the
+ *        sources it plays.
+ *
+ * The functions that don't take a mixer (NMIX_OpenAudio, NMIX_NewSource,
+ * NMIX_SetMasterGain, etc) use a default mixer, opened by NMIX_OpenAudio.
+ * Other mixers can be created with NMIX_OpenMixer (to play on another audio
+ * device) or NMIX_NewMixer (to render audio offline). Mixers are
+ * independent: different mixers can be used from different threads without
+ * any contention.
+ *
+ * \sa NMIX_NewMixer
+ * \sa NMIX_OpenMixer
+ */
+typedef struct NMIX_Mixer NMIX_Mixer;
+
+/**
+ * \enum NMIX_FadeCurve
+ * \brief The shape of the gain curve of a fade.
+ *
+ * \sa NMIX_Crossfade
+ */
+typedef enum NMIX_FadeCurve {
+  NMIX_FADE_LINEAR, /**< The gain changes linearly with time. */
+  NMIX_FADE_EQUAL_POWER, /**< The gain follows a quarter of sine wave, so
+                              that the power of two uncorrelated sources
+                              crossfaded stays constant. */
+  NMIX_FADE_EXPONENTIAL /**< The gain changes by the same number of decibels
+                             every second (silence being approximated by
+                             -60 dB), which sounds even to the ear. */
+} NMIX_FadeCurve;
+
+/**
+ * \struct NMIX_Ramp
+ * \brief A value changing progressively over time, such as a fade.
+ *
+ * \sa NMIX_Crossfade
+ * \sa NMIX_FadeGain
+ * \sa NMIX_SweepPan
+ */
+typedef struct NMIX_Ramp {
+  float from; /**< The value at the start of the ramp. */
+  float to; /**< The value at the end of the ramp, and after it. */
+  Uint64 start; /**< Mixer time (in sample frames) of the start. */
+  int length; /**< Length of the ramp in sample frames (at the mixer rate),
+                   0 if the value doesn't change. */
+  NMIX_FadeCurve curve; /**< The shape of the ramp. */
+  SDL_bool stop; /**< Set if the source stops at the end of the ramp. */
+} NMIX_Ramp;
+
+/**
+ * \enum NMIX_FilterType
+ * \brief The response of a filter.
+ *
+ * \sa NMIX_SetFilter
+ */
+typedef enum NMIX_FilterType {
+  NMIX_FILTER_NONE, /**< The data is not filtered. */
+  NMIX_FILTER_LOWPASS, /**< Attenuates the frequencies above the cutoff. */
+  NMIX_FILTER_HIGHPASS, /**< Attenuates the frequencies below the cutoff. */
+  NMIX_FILTER_BANDPASS /**< Attenuates the frequencies around the cutoff,
+                            the bandwidth getting narrower as q grows. */
+} NMIX_FilterType;
+
+/**
+ * \struct NMIX_Filter
+ * \brief A second order (biquad) filter applied on stereo data.
+ *
+ * The two channels are processed as two parallel lanes sharing the same
+ * coefficients, which compilers can vectorize.
+ *
+ * \sa NMIX_SetFilter
+ */
+typedef struct NMIX_Filter {
+  NMIX_FilterType type; /**< The response of the filter. */
+  float cutoff; /**< The cutoff frequency requested, in Hz. */
+  float q; /**< The quality factor (resonance) of the filter. */
+  float current_cutoff; /**< The cutoff frequency of the coefficients, which
+                             moves smoothly toward cutoff. */
+  float b0, b1, b2, a1, a2; /**< The normalized coefficients. */
+  float z1[2], z2[2]; /**< The state of each lane (channel). */
+} NMIX_Filter;
+
+/**
+ * \struct NMIX_Levels
+ * \brief The levels of a source or of the output, over the last buffer mixed.
+ *
+ * \sa NMIX_GetLevels
+ * \sa NMIX_GetMasterLevels
+ */
+typedef struct NMIX_Levels {
+  float peak[2]; /**< The highest absolute value of each channel. */
+  float rms[2]; /**< The root mean square of each channel. */
+  int clips; /**< The number of samples above full scale (1) since the
+                  source or the mixer was created. */
+} NMIX_Levels;
+
+/**
+ * \struct NMIX_Meter
+ * \brief The levels measured by the mixer, readable from any thread.
+ *
+ * The floats are stored as their bits, use NMIX_GetLevels to read them.
+ */
+typedef struct NMIX_Meter {
+  SDL_atomic_t peak[2];
+  SDL_atomic_t rms[2];
+  SDL_atomic_t clips;
+} NMIX_Meter;
+
+/**
+ * \enum NMIX_Waveform
+ * \brief The waveforms of the oscillators (see NMIX_NewOscillator).
+ *
+ * The waveforms are computed naively (they are not band-limited): the
+ * square, saw and triangle alias at high frequencies.
+ */
+typedef enum NMIX_Waveform {
+  NMIX_WAVE_SINE, /**< A sine. */
+  NMIX_WAVE_SQUARE, /**< A square, from 1 to -1 at half the period. */
+  NMIX_WAVE_SAW, /**< A saw, rising from -1 to 1. */
+  NMIX_WAVE_TRIANGLE, /**< A triangle, from 1 to -1 and back. */
+  NMIX_WAVE_NOISE, /**< A white noise (the frequency is ignored). */
+  NMIX_WAVE_TABLE /**< A user wavetable (see NMIX_NewWavetable). */
+} NMIX_Waveform;
+
+/**
+ * \struct NMIX_Oscillator
+ * \brief The state of a source generated by the mixer.
+ *
+ * \sa NMIX_NewOscillator
+ */
+typedef struct NMIX_Oscillator {
+  NMIX_Waveform waveform; /**< The waveform generated. */
+  float frequency; /**< The frequency (in Hz), before the pitch. */
+  Uint32 phase; /**< The position in the period, a full period being
+                     2^32. */
+  Uint32 noise; /**< The state of the noise generator. */
+  int table_bits; /**< log2 of the number of samples of the wavetable. */
+  float* table; /**< The wavetable, followed by its first sample, NULL if
+                     the waveform is not NMIX_WAVE_TABLE. */
+} NMIX_Oscillator;
+
 /**
  * \struct NMIX_Source
  * \brief Represents a sound source that can be played.
@@ -88,33 +314,192 @@ typedef void(SDLCALL* NMIX_SourceCallback)(
  * \sa NMIX_NewSource
  */
 typedef struct NMIX_Source {
+  NMIX_Mixer* mixer; /**< The mixer that plays this source, NULL once the
+                          mixer is freed. */
   int rate; /**< The sampling rate of the source (samples per second). */
   SDL_AudioFormat format; /**< The source format. */
   Uint8 channels; /**< The number of channels of the source. */
-  float pan; /**< The panning of the source (-1 < pan < 1, default = 0). */
-  float gain; /**< The gain of the source (0 < gain < 2, default = 1). */
+  float pan; /**< The panning of the source (-1 < pan < 1, default = 0), or
+                 the target of pan_ramp while it moves. */
+  float gain; /**< The gain of the source (0 < gain < 2, default = 1), or
+                   the target of gain_ramp while it moves. */
+  NMIX_Ramp pan_ramp; /**< The automation of pan. */
+  NMIX_Ramp gain_ramp; /**< The automation of gain. */
+  NMIX_Ramp fade; /**< The fade applied on top of gain (default = 1). */
+  NMIX_Filter filter; /**< The filter applied while mixing. */
+  float reverb_send; /**< The level sent to the reverb of the mixer
+                          (0 < reverb_send < 2, default = 0). */
+  float pitch; /**< The playback speed of the source (0.25 < pitch < 4,
+                    default = 1). */
+  float pitch_phase; /**< Position between two frames of the resampling. */
+  float pitch_frames[4]; /**< Stereo frames kept by the resampling. */
+  int pitch_buffered; /**< Number of frames read ahead by the resampling. */
+  NMIX_Meter meter; /**< The levels of the source (see NMIX_GetLevels). */
 
-  NMIX_SourceCallback callback; /**< Callback used to retrieve data. */
+  NMIX_SourceCallback callback; /**< Callback used to retrieve data, NULL
+                                     if the source lends its data. */
+  NMIX_SourceLendCallback lend; /**< Callback used to borrow data, NULL if
+                                     the source uses callback. */
+  NMIX_SourceSeekCallback seek; /**< Callback used to change the position of
+                                     the source, NULL if the source cannot
+                                     seek. Set by source implementations such
+                                     as NMIX_FileSource. */
+  NMIX_SourceSkipCallback skip; /**< Callback used to advance a virtual
+                                     source, NULL if the source has to be
+                                     advanced by calling callback and
+                                     dropping the data. Set by source
+                                     implementations such as
+                                     NMIX_FileSource. */
   void* userdata; /**< User-defined pointer that is passed to callback. */
+  NMIX_Oscillator* oscillator; /**< The waveform generated by the mixer,
+                                    NULL if the data comes from callback or
+                                    lend. */
   SDL_bool eof; /**< Flag set if the source has no more data to play.
                      This flag must be set to 1 in the NMIX_SourceCallback
-                     for SDL_nmix to stop the source playback. */
+                     for SDL_nmix to stop the source playback. It is set by
+                     SDL_nmix when a NMIX_SourceLendCallback returns 0. */
+
+  int in_buffer_size; /**< Size in bytes of the data requested from the
+                           callback at once. */
+  SDL_AudioStream* stream; /**< Used to convert audio data on the fly, NULL
+                                if the data is read directly by the mixer. */
+
+  Uint64 start_time; /**< Mixer time (in sample frames) at which the
+                          playback starts. */
+  Uint64 stop_time; /**< Mixer time (in sample frames) at which the playback
+                         stops, SDL_MAX_UINT64 if no stop is
+                         scheduled. */
 
-  void* in_buffer; /**< Internal audio buffer modified by the callback. */
-  int in_buffer_size; /**< Size in bytes of in_buffer. */
-  SDL_AudioStream* stream; /**< Used to convert audio data on the fly. */
-  void* out_buffer; /**< Internal audio buffer holding the converted data. */
-  int out_buffer_size; /**< Size in bytes of out_buffer. */
+  float priority; /**< The priority of the source (default = 1). */
+  float score; /**< Priority * loudness of the source, used to choose
+                    the sources that are mixed. */
+  SDL_bool virtualized; /**< Set if the source is virtual: it plays but
+                             isn't mixed. */
+  int skip_credit; /**< Number of frames (at the mixer rate) converted
+                        before the source became virtual. */
+  int skip_remainder; /**< Fraction of frame skipped (in 1/mixer rate). */
 
+  SDL_atomic_t playing; /**< Set while the source is in the list of the
+                             sources played (see NMIX_IsPlaying). */
   struct NMIX_Source* prev; /**< Previous source in list. */
   struct NMIX_Source* next; /**< Next source in list. */
 } NMIX_Source;
 
+/**
+ * \enum NMIX_Rolloff
+ * \brief The attenuation of emitters with distance.
+ *
+ * In the formulas, d is the distance between the emitter and the listener
+ * (at least min_distance), and r the rolloff factor of NMIX_EmitterBatch.
+ *
+ * \sa NMIX_UpdateEmitters
+ */
+typedef enum NMIX_Rolloff {
+  NMIX_ROLLOFF_INVERSE, /**< min_distance / (min_distance + r *
+                             (d - min_distance)), the physical attenuation
+                             when r = 1. */
+  NMIX_ROLLOFF_LINEAR, /**< 1 - r * (d - min_distance) / (max_distance -
+                            min_distance). */
+  NMIX_ROLLOFF_EXPONENTIAL /**< (d / min_distance) ^ -r. */
+} NMIX_Rolloff;
+
+/**
+ * \struct NMIX_Listener
+ * \brief The position and orientation of the listener in a 3D scene.
+ *
+ * The coordinates can be in any unit, as long as the emitters use the same
+ * one.
+ *
+ * \sa NMIX_UpdateEmitters
+ */
+typedef struct NMIX_Listener {
+  float position[3]; /**< The position of the listener. */
+  float velocity[3]; /**< The velocity of the listener (units per second),
+                          used for the Doppler effect. */
+  float forward[3]; /**< The direction the listener faces. */
+  float up[3]; /**< The up direction of the listener. */
+} NMIX_Listener;
+
+/**
+ * \struct NMIX_EmitterBatch
+ * \brief A set of sources placed in a 3D scene, as arrays of coordinates.
+ *
+ * The emitters of a batch share the same attenuation parameters. Each
+ * array holds "count" values, emitter i being sources[i] at position
+ * (x[i], y[i], z[i]).
+ *
+ * \sa NMIX_UpdateEmitters
+ */
+typedef struct NMIX_EmitterBatch {
+  int count; /**< The number of emitters. */
+  NMIX_Source** sources; /**< The source of each emitter, which must all be
+                              played by the same mixer. */
+  const float* x; /**< The x coordinates of the emitters. */
+  const float* y; /**< The y coordinates of the emitters. */
+  const float* z; /**< The z coordinates of the emitters. */
+  const float* vx; /**< The x velocities of the emitters, NULL if they are
+                        all static. */
+  const float* vy; /**< The y velocities of the emitters (or NULL). */
+  const float* vz; /**< The z velocities of the emitters (or NULL). */
+  const float* gains; /**< The gains of the emitters before attenuation,
+                           NULL if they are all 1. */
+  NMIX_Rolloff rolloff; /**< The attenuation with distance. */
+  float rolloff_factor; /**< How fast the gain decreases with distance
+                             (1 is the usual value). */
+  float min_distance; /**< The distance under which the emitters are not
+                           attenuated. */
+  float max_distance; /**< The distance from which the emitters are
+                           culled: they are muted, so that they become
+                           virtual and cost nothing to the mixer. */
+  float speed_of_sound; /**< The speed of sound (343 m/s in air), 0
+                             disables the Doppler effect. */
+} NMIX_EmitterBatch;
+
+/**
+ * \enum NMIX_CaptureFormat
+ * \brief The file format of a capture of the output (see NMIX_StartCapture).
+ */
+typedef enum NMIX_CaptureFormat {
+  NMIX_CAPTURE_RAW, /**< The samples only (stereo AUDIO_F32SYS). */
+  NMIX_CAPTURE_WAV /**< A WAV file of stereo float samples. */
+} NMIX_CaptureFormat;
+
+/**
+ * \enum NMIX_EventType
+ * \brief The kinds of events sent by the mixer (see NMIX_PollEvent).
+ */
+typedef enum NMIX_EventType {
+  NMIX_EVENT_FINISHED, /**< The source stopped by itself: it reached its end,
+                            its scheduled stop (NMIX_StopAt) or the end of a
+                            fade that stops it. */
+  NMIX_EVENT_LOOPED, /**< The source went back to its loop start. */
+  NMIX_EVENT_STOLEN, /**< The source became virtual because more important
+                          sources took all the voices (see
+                          NMIX_SetMaxVoices). */
+  NMIX_EVENT_UNDERRUN /**< The render-ahead thread didn't mix the output in
+                           time (see NMIX_StartRenderAhead). */
+} NMIX_EventType;
+
+/**
+ * \struct NMIX_Event
+ * \brief Something that happened while mixing.
+ */
+typedef struct NMIX_Event {
+  NMIX_EventType type; /**< The kind of event. */
+  struct NMIX_Source* source; /**< The source concerned, NULL for
+                                   NMIX_EVENT_UNDERRUN. It may have been
+                                   freed since the event was sent. */
+  Uint64 time; /**< The mixer time of the buffer in which the event
+                    happened. */
+} NMIX_Event;
+
 /**
  * \fn int NMIX_OpenAudio(const char* device, int freq, int samples)
  * \brief Opens an audio device and initializes SDL_nmix.
  *
- * This should be called once before any other SDL_nmix call.
+ * This should be called once before any other SDL_nmix call. It opens the
+ * default mixer (see NMIX_GetDefaultMixer), used by all the functions that
+ * don't take a NMIX_Mixer.
  * Passing in a device name of NULL requests the most reasonable default.
  *
  * If you're unsure about what to pass here, you can use SDL_nmix defaults:
@@ -141,7 +526,8 @@ int NMIX_OpenAudio(const char* device, int rate, int samples);
  * \brief Closes the audio device.
  *
  * This function should be called once at the end of the program,
- * before SDL_Quit().
+ * before SDL_Quit(). The sources that are not freed yet stop playing: they
+ * can only be freed afterwards.
  *
  *   \return zero on success, -1 on error. You can retrieve the error message
  *           with a call to SDL_GetError()
@@ -173,6 +559,20 @@ void NMIX_PausePlayback(SDL_bool pause_on);
  */
 float NMIX_GetMasterGain(void);
 
+/**
+ * \fn void NMIX_GetMasterLevels(NMIX_Levels* levels)
+ * \brief Returns the levels of the output of SDL_nmix.
+ *
+ * The levels are measured on the final mix, before it is clamped: the peak
+ * can be above 1, and the clips count the samples clamped. They are updated
+ * every audio buffer, and can be read from any thread.
+ *
+ *    \param levels Receives the levels
+ *
+ * \sa NMIX_GetLevels
+ */
+void NMIX_GetMasterLevels(NMIX_Levels* levels);
+
 /**
  * \fn void NMIX_SetMasterGain(float gain)
  * \brief Sets the master gain.
@@ -186,10 +586,210 @@ float NMIX_GetMasterGain(void);
  */
 void NMIX_SetMasterGain(float gain);
 
+/**
+ * \fn SDL_bool NMIX_GetDither(void)
+ * \brief Returns whether the output is dithered.
+ *
+ *   \return SDL_TRUE if the output is dithered
+ *
+ * \sa NMIX_SetDither
+ */
+SDL_bool NMIX_GetDither(void);
+
+/**
+ * \fn void NMIX_SetDither(SDL_bool dither)
+ * \brief Enables or disables the dither of the output.
+ *
+ * SDL_nmix mixes float samples, and opens the audio device in its native
+ * format when it is float, 16 or 32 bit signed samples, so that SDL doesn't
+ * need to convert them. When the device uses 16 bit samples, a triangular
+ * dither (a noise of 1 bit) is added to the output before it is rounded,
+ * which removes the distortion of the quiet sounds. It is enabled by
+ * default, and has no effect with the other formats.
+ *
+ *    \param dither SDL_TRUE to dither the output, SDL_FALSE to round it
+ *
+ * \sa NMIX_GetDither
+ */
+void NMIX_SetDither(SDL_bool dither);
+
+/**
+ * \fn int NMIX_StartRenderAhead(int blocks, int block_frames)
+ * \brief Mixes the output ahead of the audio device, in a thread.
+ *
+ * By default, the sources are mixed by the audio callback, so any spike in
+ * the time taken to decode or mix them can make the device miss its
+ * deadline. In render-ahead mode, a thread owned by SDL_nmix keeps "blocks"
+ * blocks of "block_frames" frames mixed in advance, and the audio callback
+ * only copies them: the spikes shorter than the data mixed ahead are not
+ * heard, and the size of the blocks can differ from the size of the device
+ * buffers.
+ *
+ * The data mixed ahead adds to the latency: the mixer time (NMIX_GetTime)
+ * and the changes made to the sources are ahead of what is heard by
+ * blocks * block_frames frames.
+ *
+ *    \param blocks The number of blocks mixed ahead
+ *    \param block_frames The size of the blocks, in sample frames
+ *   \return zero on success, -1 on error. You can retrieve the error message
+ *           with a call to SDL_GetError()
+ *
+ * \sa NMIX_StopRenderAhead
+ * \sa NMIX_GetRenderAheadFill
+ * \sa NMIX_GetUnderruns
+ */
+int NMIX_StartRenderAhead(int blocks, int block_frames);
+
+/**
+ * \fn int NMIX_StopRenderAhead(void)
+ * \brief Goes back to mixing the output in the audio callback.
+ *
+ * The data mixed ahead is dropped.
+ *
+ *   \return zero on success, -1 if the output isn't rendered ahead. You can
+ *           retrieve the error message with a call to SDL_GetError()
+ *
+ * \sa NMIX_StartRenderAhead
+ */
+int NMIX_StopRenderAhead(void);
+
+/**
+ * \fn int NMIX_GetRenderAheadFill(void)
+ * \brief Returns the number of frames currently mixed ahead.
+ *
+ * A fill that often drops close to 0 means that the render-ahead thread
+ * barely keeps up with the device.
+ *
+ *   \return The number of sample frames ready to be played, 0 if the output
+ *           isn't rendered ahead
+ *
+ * \sa NMIX_StartRenderAhead
+ */
+int NMIX_GetRenderAheadFill(void);
+
+/**
+ * \fn int NMIX_GetUnderruns(void)
+ * \brief Returns the number of buffers the render-ahead thread missed.
+ *
+ * When the thread doesn't mix fast enough, the audio callback plays the
+ * missing frames as silence and counts an underrun.
+ *
+ *   \return The number of underruns since the mixer was opened
+ *
+ * \sa NMIX_StartRenderAhead
+ */
+int NMIX_GetUnderruns(void);
+
+/**
+ * \fn int NMIX_StartCapture(SDL_RWops* dst, NMIX_CaptureFormat format,
+ *                            int freedst)
+ * \brief Starts recording the output of SDL_nmix.
+ *
+ * Each buffer of the final mix (after the master gain, filter and reverb,
+ * before the conversion to the format of the device) is written to "dst".
+ * The audio thread only copies the buffers into a ring holding about a
+ * second of audio, which a background thread writes to "dst": if the writer
+ * falls behind, whole buffers are dropped rather than blocking the audio
+ * thread (see NMIX_GetCaptureDropped).
+ *
+ * \code
+ * NMIX_StartCapture(SDL_RWFromFile("capture.wav", "wb"), NMIX_CAPTURE_WAV, 1);
+ * \endcode
+ *
+ *    \param dst The destination. The WAV header is completed when the
+ *           capture stops, which requires "dst" to be seekable. A WAV
+ *           header can't record more than 4 GiB of data (about 3 hours at
+ *           48000 Hz): a longer capture is written entirely but its header
+ *           only covers the first 4 GiB.
+ *    \param format The format of the file
+ *    \param freedst Non-zero to close "dst" when the capture stops
+ *   \return zero on success, -1 on error. You can retrieve the error message
+ *           with a call to SDL_GetError()
+ *
+ * \sa NMIX_StopCapture
+ */
+int NMIX_StartCapture(SDL_RWops* dst, NMIX_CaptureFormat format, int freedst);
+
+/**
+ * \fn int NMIX_StopCapture(void)
+ * \brief Stops recording the output of SDL_nmix.
+ *
+ * This waits for all the captured buffers to be written.
+ *
+ *   \return zero on success, -1 if there was no capture or if the data
+ *           couldn't be written. You can retrieve the error message with a
+ *           call to SDL_GetError()
+ *
+ * \sa NMIX_StartCapture
+ */
+int NMIX_StopCapture(void);
+
+/**
+ * \fn int NMIX_GetCaptureDropped(void)
+ * \brief Returns the number of buffers missing from the current capture.
+ *
+ * Buffers are dropped when the capture can't be written as fast as the
+ * audio is mixed.
+ *
+ *   \return The number of buffers dropped, 0 if there is no capture
+ *
+ * \sa NMIX_StartCapture
+ */
+int NMIX_GetCaptureDropped(void);
+
+/**
+ * \fn int NMIX_SetMasterFilter(NMIX_FilterType type, float cutoff, float q)
+ * \brief Sets the filter applied on the output of the mixer.
+ *
+ * The filter is applied after all the sources are mixed, eg. to muffle the
+ * whole soundscape while the game is paused. See NMIX_SetFilter for the
+ * parameters.
+ *
+ *   \return zero on success, -1 on error. You can retrieve the error message
+ *           with a call to SDL_GetError()
+ *
+ * \sa NMIX_SetFilter
+ */
+int NMIX_SetMasterFilter(NMIX_FilterType type, float cutoff, float q);
+
+/**
+ * \fn int NMIX_SetReverb(const float* ir, int frames, Uint8 channels)
+ * \brief Sets the impulse response of the reverb of the mixer.
+ *
+ * The mixer has a single reverb, shared by all the sources: each source
+ * sends a part of its output to it (see NMIX_SetReverbSend), and the sum of
+ * what is sent is convolved with the impulse response, then added to the
+ * output. The cost of the reverb is the same whatever the number of sources
+ * sending to it, and for a given impulse response it is the same for every
+ * audio buffer, as the convolution is computed by blocks of 512 frames with
+ * FFTs (which adds a latency of 512 frames to the reverb).
+ *
+ * The impulse response is normalized, so that the reverb of a white noise
+ * is as loud as the noise. To load an impulse response from a file, use
+ * NMIX_LoadReverb.
+ *
+ *    \param ir The impulse response: float samples, at the mixer rate,
+ *           interleaved if it is stereo. It is copied, it can be freed
+ *           after this call. NULL removes the reverb.
+ *    \param frames The number of sample frames of the impulse response
+ *    \param channels The number of channels of the impulse response, 1 or 2
+ *           (left and right reverbs)
+ *   \return zero on success, -1 on error. You can retrieve the error message
+ *           with a call to SDL_GetError()
+ *
+ * \sa NMIX_SetReverbSend
+ * \sa NMIX_LoadReverb
+ */
+int NMIX_SetReverb(const float* ir, int frames, Uint8 channels);
+
 /**
  * \fn SDL_AudioSpec* NMIX_GetAudioSpec(void)
  * \brief Returns the internal audio spec used by SDL_nmix.
  *
+ * This is the format used for mixing (stereo AUDIO_F32SYS samples). The
+ * audio device may use another sample format, the mix is then converted to
+ * it (see NMIX_SetDither).
+ *
  *   \return The audio spec
  *
  */
@@ -204,6 +804,27 @@ SDL_AudioSpec* NMIX_GetAudioSpec(void);
  */
 SDL_AudioDeviceID NMIX_GetAudioDevice(void);
 
+/**
+ * \fn Uint64 NMIX_GetTime(void)
+ * \brief Returns the mixer clock.
+ *
+ * The mixer clock is a monotonic counter of the sample frames mixed since
+ * the audio device was opened. The value returned is the time of the first
+ * frame of the next audio buffer to be mixed, so it can be used as a base to
+ * schedule sources with NMIX_PlayAt and NMIX_StopAt:
+ *
+ * \code
+ * // plays a source exactly half a second from now
+ * NMIX_PlayAt(source, NMIX_GetTime() + NMIX_GetAudioSpec()->freq / 2);
+ * \endcode
+ *
+ *   \return The mixer time, in sample frames
+ *
+ * \sa NMIX_PlayAt
+ * \sa NMIX_StopAt
+ */
+Uint64 NMIX_GetTime(void);
+
 /**
  * \fn NMIX_Source* NMIX_NewSource(SDL_AudioFormat format, Uint8 channels,
  *         int rate, NMIX_SourceCallback callback, void* userdata);
@@ -231,7 +852,9 @@ SDL_AudioDeviceID NMIX_GetAudioDevice(void);
  *
  * SDL_nmix internally uses AUDIO_F32SYS for mixing the sources together. If
  * your source is in another format, SDL_nmix will automatically convert your
- * audio data on the fly.
+ * audio data on the fly. Mono and stereo sources in AUDIO_F32SYS or
+ * AUDIO_S16SYS format, at the rate of the mixer, are the cheapest to play:
+ * they are converted and panned directly while mixing.
  *
  * If the source has more than 1 channel, the audio data must be
  * interleaved (LRLRLR ordering).
@@ -245,17 +868,96 @@ SDL_AudioDeviceID NMIX_GetAudioDevice(void);
  *           with a call to SDL_GetError()
  *
  * \sa NMIX_SourceCallback
+ * \sa NMIX_NewLendSource
  * \sa NMIX_FreeSource
  */
 NMIX_Source* NMIX_NewSource(SDL_AudioFormat format, Uint8 channels, int rate,
     NMIX_SourceCallback callback, void* userdata);
 
+/**
+ * \fn NMIX_Source* NMIX_NewLendSource(SDL_AudioFormat format, Uint8 channels,
+ *         int rate, NMIX_SourceLendCallback lend, void* userdata);
+ * \brief Creates a new NMIX_Source that lends its data to the mixer.
+ *
+ * Same as NMIX_NewSource, but instead of filling a buffer, the callback
+ * returns a pointer to data the source already holds (a decoded buffer, a
+ * wavetable, a memory-mapped file...). This saves a copy of the data each
+ * time the mixer needs more of it.
+ *
+ * This is an example of callback lending a buffer of "length" bytes:
+ *
+ * \code
+ * int my_lend(void* userdata, const void** data, int len) {
+ *     my_sound* sound = userdata;
+ *     int n = min(len, sound->length - sound->position);
+ *
+ *     *data = sound->buffer + sound->position;
+ *     sound->position += n;
+ *     return n;
+ * }
+ * \endcode
+ *
+ *    \param format The format of the source samples
+ *    \param channels The number of channels of the source
+ *    \param rate The sampling rate of the source
+ *    \param lend Callback function, called when more audio data is needed
+ *    \param userdata Userdata passed to lend
+ *   \return The new source, or NULL on error. You can retrieve the error
+ *           message with a call to SDL_GetError()
+ *
+ * \sa NMIX_SourceLendCallback
+ * \sa NMIX_FreeSource
+ */
+NMIX_Source* NMIX_NewLendSource(SDL_AudioFormat format, Uint8 channels,
+    int rate, NMIX_SourceLendCallback lend, void* userdata);
+
+/**
+ * \fn NMIX_Source* NMIX_NewOscillator(NMIX_Waveform waveform,
+ *         float frequency)
+ * \brief Creates a new NMIX_Source generating a waveform.
+ *
+ * The samples are computed by the mixer right into the mix, from a phase
+ * accumulator: there is no callback, no conversion and no buffer, which
+ * makes oscillators much cheaper than a source computing "sinf" in its
+ * callback. The source is mono, it is played like any other source (gain,
+ * pan, pitch, filter...), and never ends.
+ *
+ *    \param waveform The waveform (but NMIX_WAVE_TABLE, see
+ *           NMIX_NewWavetable)
+ *    \param frequency The frequency (in Hz)
+ *   \return The new source, or NULL on error. You can retrieve the error
+ *           message with a call to SDL_GetError()
+ *
+ * \sa NMIX_SetFrequency
+ * \sa NMIX_FreeSource
+ */
+NMIX_Source* NMIX_NewOscillator(NMIX_Waveform waveform, float frequency);
+
+/**
+ * \fn NMIX_Source* NMIX_NewWavetable(const float* table, int size,
+ *         float frequency)
+ * \brief Creates a new NMIX_Source playing a wavetable in a loop.
+ *
+ * Same as NMIX_NewOscillator, the waveform being one period given by the
+ * user (it is copied). The table is read with a linear interpolation.
+ *
+ *    \param table The samples of one period of the waveform
+ *    \param size The number of samples, a power of two up to 65536
+ *    \param frequency The frequency (in Hz) at which the table is played
+ *   \return The new source, or NULL on error. You can retrieve the error
+ *           message with a call to SDL_GetError()
+ *
+ * \sa NMIX_NewOscillator
+ */
+NMIX_Source* NMIX_NewWavetable(const float* table, int size, float frequency);
+
 /**
  * \fn void NMIX_FreeSource(NMIX_Source* source)
  * \brief Frees a NMIX_Source from memory.
  *
  * If the source is currently playing, NMIX_FreeSource will automatically
  * pause it before freeing it.
+ * A source can be freed after its mixer (e.g. after NMIX_CloseAudio).
  *
  *    \param source The source to free
  *
@@ -277,6 +979,25 @@ void NMIX_FreeSource(NMIX_Source* source);
  */
 int NMIX_Play(NMIX_Source* source);
 
+/**
+ * \fn int NMIX_PlayAt(NMIX_Source* source, Uint64 time)
+ * \brief Plays a NMIX_Source at a given mixer time.
+ *
+ * The source starts exactly at the sample frame "time" of the mixer clock,
+ * even if that frame lies in the middle of an audio buffer. If "time" is
+ * already in the past, the source starts at the beginning of the next audio
+ * buffer (same as NMIX_Play).
+ *
+ *    \param source The source to be played
+ *    \param time The mixer time (in sample frames) at which the source starts
+ *   \return zero on success, -1 on error. You can retrieve the error message
+ *           with a call to SDL_GetError()
+ *
+ * \sa NMIX_GetTime
+ * \sa NMIX_StopAt
+ */
+int NMIX_PlayAt(NMIX_Source* source, Uint64 time);
+
 /**
  * \fn void NMIX_Pause(NMIX_Source* source)
  * \brief Pauses a NMIX_Source.
@@ -289,10 +1010,30 @@ int NMIX_Play(NMIX_Source* source);
  */
 void NMIX_Pause(NMIX_Source* source);
 
+/**
+ * \fn void NMIX_StopAt(NMIX_Source* source, Uint64 time)
+ * \brief Pauses a NMIX_Source at a given mixer time.
+ *
+ * The source stops exactly at the sample frame "time" of the mixer clock. The
+ * stop can be scheduled before the source is played, for example to play a
+ * sound for an exact number of frames. If "time" is already in the past,
+ * the source stops at the beginning of the next audio buffer.
+ *
+ *    \param source The source to be paused
+ *    \param time The mixer time (in sample frames) at which the source stops
+ *
+ * \sa NMIX_GetTime
+ * \sa NMIX_PlayAt
+ */
+void NMIX_StopAt(NMIX_Source* source, Uint64 time);
+
 /**
  * \fn SDL_bool NMIX_IsPlaying(NMIX_Source* source)
  * \brief Returns whether a NMIX_Source is currently playing.
  *
+ * This can be called from any thread without locking the mixer. To learn
+ * when sources finish without polling each of them, use NMIX_PollEvent.
+ *
  *    \param source The source to query
  *   \return 1 if the source is playing, 0 if the source is not playing
  *
@@ -318,15 +1059,37 @@ float NMIX_GetPan(NMIX_Source* source);
  * \brief Sets linear stereo panning of a NMIX_Source.
  *
  * This panning will be applied while mixing all sources together, which means
- * that all sources (even mono sources) can be panned.
+ * that all sources (even mono sources) can be panned. A sweep started with
+ * NMIX_SweepPan is cancelled.
  *
  *    \param source The source to pan
  *    \param pan The panning setting for this source (between -1 and 1)
  *
  * \sa NMIX_GetPan
+ * \sa NMIX_SweepPan
  */
 void NMIX_SetPan(NMIX_Source* source, float pan);
 
+/**
+ * \fn int NMIX_SweepPan(NMIX_Source* source, float pan, int ms)
+ * \brief Moves the panning of a NMIX_Source progressively.
+ *
+ * The panning goes linearly from its current value to "pan" in "ms"
+ * milliseconds, starting at the next audio buffer. It is computed by the
+ * mixer for every sample, so the sweep is smooth whatever the frame rate of
+ * the calling thread. NMIX_GetPan returns the target of the sweep.
+ *
+ *    \param source The source to pan
+ *    \param pan The final panning (between -1 and 1)
+ *    \param ms The duration of the sweep, in milliseconds
+ *   \return zero on success, -1 on error. You can retrieve the error message
+ *           with a call to SDL_GetError()
+ *
+ * \sa NMIX_SetPan
+ * \sa NMIX_FadeGain
+ */
+int NMIX_SweepPan(NMIX_Source* source, float pan, int ms);
+
 /**
  * \fn float NMIX_GetGain(NMIX_Source* source)
  * \brief Returns the gain of a NMIX_Source.
@@ -344,13 +1107,783 @@ float NMIX_GetGain(NMIX_Source* source);
  * \fn void NMIX_SetGain(NMIX_Source* source, float gain)
  * \brief Sets the gain of a NMIX_Source.
  *
- * Default gain is 1 (100%), and can be set from 0 (muted) to 2 (200%).
+ * Default gain is 1 (100%), and can be set from 0 (muted) to 2 (200%). A
+ * fade started with NMIX_FadeGain is cancelled.
  *
  *    \param source The source to pan
  *    \param gain The gain setting for this source (between 0 and 2)
  *
  * \sa NMIX_GetGain
+ * \sa NMIX_FadeGain
  */
 void NMIX_SetGain(NMIX_Source* source, float gain);
 
+/**
+ * \fn int NMIX_FadeGain(NMIX_Source* source, float gain, int ms,
+ *                        NMIX_FadeCurve curve, SDL_bool stop)
+ * \brief Changes the gain of a NMIX_Source progressively.
+ *
+ * The gain goes from its current value to "gain" in "ms" milliseconds,
+ * starting at the next audio buffer. It is computed by the mixer for every
+ * sample, so the fade is smooth whatever the frame rate of the calling
+ * thread, and costs nothing to this thread until it completes. NMIX_GetGain
+ * returns the target of the fade.
+ *
+ * \code
+ * // fades a sound out in half a second, then stops it
+ * NMIX_FadeGain(sound, 0, 500, NMIX_FADE_EXPONENTIAL, SDL_TRUE);
+ * \endcode
+ *
+ * The gain stays at its target after a fade that stops the source: call
+ * NMIX_SetGain before playing it again.
+ *
+ *    \param source The source to fade
+ *    \param gain The final gain (between 0 and 2)
+ *    \param ms The duration of the fade, in milliseconds
+ *    \param curve The shape of the fade
+ *    \param stop Whether the source stops when the fade completes
+ *   \return zero on success, -1 on error. You can retrieve the error message
+ *           with a call to SDL_GetError()
+ *
+ * \sa NMIX_SetGain
+ * \sa NMIX_SweepPan
+ * \sa NMIX_Crossfade
+ */
+int NMIX_FadeGain(NMIX_Source* source, float gain, int ms,
+    NMIX_FadeCurve curve, SDL_bool stop);
+
+/**
+ * \fn int NMIX_Crossfade(NMIX_Source* from, NMIX_Source* to, int ms,
+ *                         NMIX_FadeCurve curve)
+ * \brief Fades a NMIX_Source out while fading another one in.
+ *
+ * Over "ms" milliseconds, starting at the next audio buffer, "from" fades
+ * out and stops, while "to" fades in (it starts playing from silence if it
+ * is paused). The fades are applied on top of the gains of the sources, and
+ * computed by the mixer for every sample: the transition is smooth and costs
+ * nothing to the calling thread after this call. Calling NMIX_Crossfade
+ * again during a crossfade starts new fades from the current levels, so a
+ * transition can be reverted.
+ *
+ * The stream which fades in should be ready to play without decoding
+ * anything on the audio thread: for a streamed NMIX_FileSource, call
+ * NMIX_SeekAsync some time before the crossfade, so that its first buffers
+ * are prerolled by the decoding thread:
+ *
+ * \code
+ * NMIX_SeekAsync(next_music, 0); // when the transition is known
+ * ...
+ * NMIX_Crossfade(music->source, next_music->source, 2000,
+ *     NMIX_FADE_EQUAL_POWER);
+ * \endcode
+ *
+ *    \param from The source to fade out, or NULL to only fade "to" in
+ *    \param to The source to fade in, or NULL to only fade "from" out
+ *    \param ms The duration of the crossfade, in milliseconds
+ *    \param curve The shape of the fades, NMIX_FADE_EQUAL_POWER keeps the
+ *           loudness constant during a crossfade between two different
+ *           musics, NMIX_FADE_LINEAR suits sources that are correlated
+ *   \return zero on success, -1 on error (eg. sources played by different
+ *           mixers). You can retrieve the error message with a call to
+ *           SDL_GetError()
+ *
+ * \sa NMIX_SeekAsync
+ */
+int NMIX_Crossfade(
+    NMIX_Source* from, NMIX_Source* to, int ms, NMIX_FadeCurve curve);
+
+/**
+ * \fn int NMIX_SetFilter(NMIX_Source* source, NMIX_FilterType type,
+ *                         float cutoff, float q)
+ * \brief Sets the filter applied on a NMIX_Source.
+ *
+ * The filter is applied by the mixer, at the mixer rate, on the data of the
+ * source once converted: it is typically used for occlusion or underwater
+ * effects. When only the cutoff frequency changes, it moves progressively
+ * to its new value (in about 20 milliseconds) to avoid clicks, so it can be
+ * modified at every frame of the game.
+ *
+ * \code
+ * // the wall between the listener and the sound muffles it
+ * NMIX_SetFilter(sound, NMIX_FILTER_LOWPASS, 800, 0.707f);
+ * \endcode
+ *
+ *    \param source The source to filter
+ *    \param type The response of the filter, NMIX_FILTER_NONE to remove it
+ *    \param cutoff The cutoff (or center) frequency in Hz, clamped to the
+ *           range the mixer rate can represent
+ *    \param q The quality factor: 0.707 (1 / sqrt(2)) gives a flat response
+ *           in the pass band, higher values give a resonance at the cutoff
+ *   \return zero on success, -1 on error (eg. q is not positive). You can
+ *           retrieve the error message with a call to SDL_GetError()
+ *
+ * \sa NMIX_SetMasterFilter
+ */
+int NMIX_SetFilter(
+    NMIX_Source* source, NMIX_FilterType type, float cutoff, float q);
+
+/**
+ * \fn float NMIX_GetReverbSend(NMIX_Source* source)
+ * \brief Returns the level a NMIX_Source sends to the reverb.
+ *
+ *    \param source The source to query
+ *   \return The send level of this source (default = 0)
+ *
+ * \sa NMIX_SetReverbSend
+ */
+float NMIX_GetReverbSend(NMIX_Source* source);
+
+/**
+ * \fn void NMIX_SetReverbSend(NMIX_Source* source, float level)
+ * \brief Sets the level a NMIX_Source sends to the reverb.
+ *
+ * The output of the source (after its gain, panning and filter) is sent to
+ * the reverb of the mixer with this level, in addition to being played
+ * directly. The default is 0: the source is dry.
+ *
+ *    \param source The source to modify
+ *    \param level The send level (between 0 and 2)
+ *
+ * \sa NMIX_GetReverbSend
+ * \sa NMIX_SetReverb
+ */
+void NMIX_SetReverbSend(NMIX_Source* source, float level);
+
+/**
+ * \fn float NMIX_GetPitch(NMIX_Source* source)
+ * \brief Returns the pitch of a NMIX_Source.
+ *
+ *    \param source The source to query
+ *   \return The pitch of this source (default = 1)
+ *
+ * \sa NMIX_SetPitch
+ */
+float NMIX_GetPitch(NMIX_Source* source);
+
+/**
+ * \fn void NMIX_SetPitch(NMIX_Source* source, float pitch)
+ * \brief Sets the pitch (playback speed) of a NMIX_Source.
+ *
+ * A pitch of 2 plays the source twice as fast, one octave higher. The data
+ * is resampled with a linear interpolation, once converted to the mixer
+ * format.
+ *
+ *    \param source The source to modify
+ *    \param pitch The playback speed (between 0.25 and 4, default = 1)
+ *
+ * \sa NMIX_GetPitch
+ * \sa NMIX_UpdateEmitters
+ */
+void NMIX_SetPitch(NMIX_Source* source, float pitch);
+
+/**
+ * \fn float NMIX_GetFrequency(NMIX_Source* source)
+ * \brief Returns the frequency of an oscillator.
+ *
+ *    \param source The source to query
+ *   \return The frequency (in Hz), 0 if the source is not an oscillator
+ *
+ * \sa NMIX_SetFrequency
+ */
+float NMIX_GetFrequency(NMIX_Source* source);
+
+/**
+ * \fn void NMIX_SetFrequency(NMIX_Source* source, float frequency)
+ * \brief Sets the frequency of an oscillator.
+ *
+ * The phase is kept, so that the waveform has no discontinuity. The pitch
+ * of the source multiplies this frequency.
+ *
+ *    \param source The source to modify, made by NMIX_NewOscillator or
+ *           NMIX_NewWavetable
+ *    \param frequency The frequency (in Hz)
+ *
+ * \sa NMIX_GetFrequency
+ */
+void NMIX_SetFrequency(NMIX_Source* source, float frequency);
+
+/**
+ * \fn int NMIX_UpdateEmitters(const NMIX_Listener* listener,
+ *                              const NMIX_EmitterBatch* batch)
+ * \brief Updates the gain, panning and pitch of a batch of 3D emitters.
+ *
+ * For each emitter, the gain is attenuated with its distance to the
+ * listener, the panning follows its direction (with an equal-power law),
+ * and the pitch follows the Doppler effect if velocities are given. The
+ * computations are done on whole arrays of coordinates, and the changes
+ * are handed to the mixer at once: with a single lock, or recorded in the
+ * current batch if NMIX_BeginBatch was called. The emitters farther than
+ * max_distance are muted (so they become virtual), and the ones which were
+ * already muted are skipped.
+ *
+ * \code
+ * NMIX_Listener listener = {{px, py, pz}, {0, 0, 0}, {0, 0, -1}, {0, 1, 0}};
+ * NMIX_EmitterBatch batch = {0};
+ * batch.count = nb_birds;
+ * batch.sources = bird_sources;
+ * batch.x = bird_x;
+ * batch.y = bird_y;
+ * batch.z = bird_z;
+ * batch.rolloff = NMIX_ROLLOFF_INVERSE;
+ * batch.rolloff_factor = 1;
+ * batch.min_distance = 1;
+ * batch.max_distance = 100;
+ * NMIX_UpdateEmitters(&listener, &batch);
+ * \endcode
+ *
+ * The gains, pannings and pitches set by this function replace the ones
+ * set by NMIX_SetGain, NMIX_SetPan and NMIX_SetPitch.
+ *
+ *    \param listener The listener
+ *    \param batch The emitters to update
+ *   \return zero on success, -1 on error. You can retrieve the error message
+ *           with a call to SDL_GetError()
+ *
+ * \sa NMIX_SetMaxVoices
+ */
+int NMIX_UpdateEmitters(
+    const NMIX_Listener* listener, const NMIX_EmitterBatch* batch);
+
+/**
+ * \fn int NMIX_SeekSource(NMIX_Source* source, Sint64 frame)
+ * \brief Modifies the position of a NMIX_Source.
+ *
+ * Only sources that provide a seek callback (such as NMIX_FileSource) can
+ * seek. The audio data already converted for the old position is discarded.
+ * An oscillator moves its phase (seeking to 0 restarts its period).
+ *
+ *    \param source The source to seek
+ *    \param frame The new position, in sample frames (at the source rate)
+ *           from the beginning of the source
+ *   \return zero on success, -1 on error. You can retrieve the error message
+ *           with a call to SDL_GetError()
+ *
+ * \sa NMIX_SourceSeekCallback
+ */
+int NMIX_SeekSource(NMIX_Source* source, Sint64 frame);
+
+/**
+ * \fn float NMIX_GetPriority(NMIX_Source* source)
+ * \brief Returns the priority of a NMIX_Source.
+ *
+ *    \param source The source to query
+ *   \return The priority of this source (default = 1)
+ *
+ * \sa NMIX_SetPriority
+ */
+float NMIX_GetPriority(NMIX_Source* source);
+
+/**
+ * \fn void NMIX_SetPriority(NMIX_Source* source, float priority)
+ * \brief Sets the priority of a NMIX_Source.
+ *
+ * When more sources are playing than the limit set by NMIX_SetMaxVoices,
+ * only the sources with the highest priority * gain are mixed, the others
+ * become virtual.
+ *
+ *    \param source The source to modify
+ *    \param priority The priority of this source (0 or more, default = 1)
+ *
+ * \sa NMIX_GetPriority
+ * \sa NMIX_SetMaxVoices
+ */
+void NMIX_SetPriority(NMIX_Source* source, float priority);
+
+/**
+ * \fn SDL_bool NMIX_IsVirtual(NMIX_Source* source)
+ * \brief Returns whether a NMIX_Source is currently virtual.
+ *
+ * A virtual source is playing (its position advances with time) but it is
+ * not decoded, converted nor mixed, because it is inaudible or because
+ * there are too many sources playing. It becomes real again as soon as it
+ * is audible, starting from where it would have been if it was mixed.
+ *
+ *    \param source The source to query
+ *   \return 1 if the source is playing and virtual, 0 otherwise
+ *
+ * \sa NMIX_SetVirtualThreshold
+ * \sa NMIX_SetMaxVoices
+ */
+SDL_bool NMIX_IsVirtual(NMIX_Source* source);
+
+/**
+ * \fn void NMIX_GetLevels(NMIX_Source* source, NMIX_Levels* levels)
+ * \brief Returns the levels of a NMIX_Source, for VU meters or debugging.
+ *
+ * The levels are measured by the mixer while it mixes the source, after its
+ * gain, fade and panning, so they cost almost nothing. They are updated
+ * every audio buffer, and can be read from any thread without locking the
+ * mixer. The levels of a source that is paused or virtual are 0.
+ *
+ *    \param source The source to query
+ *    \param levels Receives the levels
+ *
+ * \sa NMIX_GetMasterLevels
+ */
+void NMIX_GetLevels(NMIX_Source* source, NMIX_Levels* levels);
+
+/**
+ * \fn int NMIX_PollEvent(NMIX_Event* event)
+ * \brief Retrieves the next event sent by the mixer.
+ *
+ * The mixer sends an event when a source finishes, loops or is stolen, and
+ * when the render-ahead thread is late. The events are queued without
+ * locking, so that the audio thread never waits for the game: call this
+ * function regularly (from a single thread), until it returns 0. The queue
+ * holds 256 events, the events sent while it is full are lost.
+ *
+ * \code
+ * NMIX_Event event;
+ * while (NMIX_PollEvent(&event)) {
+ *   if (event.type == NMIX_EVENT_FINISHED) {
+ *     // event.source is done
+ *   }
+ * }
+ * \endcode
+ *
+ *    \param event Receives the event
+ *   \return 1 if an event was retrieved, 0 if there are no more events
+ *
+ * \sa NMIX_PushEvent
+ */
+int NMIX_PollEvent(NMIX_Event* event);
+
+/**
+ * \fn void NMIX_PushEvent(NMIX_Source* source, NMIX_EventType type)
+ * \brief Sends an event about a source.
+ *
+ * This is used by source implementations, such as NMIX_FileSource which
+ * sends NMIX_EVENT_LOOPED. It must be called while mixing (from a source
+ * callback), or with the mixer locked.
+ *
+ *    \param source The source concerned
+ *    \param type The kind of event
+ *
+ * \sa NMIX_PollEvent
+ */
+void NMIX_PushEvent(NMIX_Source* source, NMIX_EventType type);
+
+/**
+ * \fn float NMIX_GetVirtualThreshold(void)
+ * \brief Returns the gain under which sources become virtual.
+ *
+ *   \return The threshold (default = 0)
+ *
+ * \sa NMIX_SetVirtualThreshold
+ */
+float NMIX_GetVirtualThreshold(void);
+
+/**
+ * \fn void NMIX_SetVirtualThreshold(float gain)
+ * \brief Sets the gain under which sources become virtual.
+ *
+ * Sources with a gain lower than or equal to this threshold are considered
+ * inaudible: they keep playing (their position advances with time) but they
+ * are not mixed. The default is 0, which means that only muted sources
+ * become virtual.
+ *
+ * The sources that provide a skip callback (such as NMIX_FileSource) are
+ * advanced without being decoded; for the other sources the callback is
+ * still called, but its data is dropped without being converted nor mixed.
+ *
+ *    \param gain The threshold (between 0 and 2)
+ *
+ * \sa NMIX_IsVirtual
+ */
+void NMIX_SetVirtualThreshold(float gain);
+
+/**
+ * \fn int NMIX_GetMaxVoices(void)
+ * \brief Returns the maximum number of sources mixed at the same time.
+ *
+ *   \return The maximum number of sources mixed, 0 if there is no limit
+ *
+ * \sa NMIX_SetMaxVoices
+ */
+int NMIX_GetMaxVoices(void);
+
+/**
+ * \fn void NMIX_SetMaxVoices(int count)
+ * \brief Sets the maximum number of sources mixed at the same time.
+ *
+ * When more sources are audible, only the "count" sources with the highest
+ * priority * gain are mixed, the other ones are virtual. This allows playing
+ * thousands of sources while only paying for the audible ones.
+ *
+ *    \param count The maximum number of sources mixed (0 = no limit, the
+ *           default)
+ *
+ * \sa NMIX_SetPriority
+ * \sa NMIX_IsVirtual
+ */
+void NMIX_SetMaxVoices(int count);
+
+/**
+ * \fn void NMIX_BeginBatch(void)
+ * \brief Starts recording a batch of source changes.
+ *
+ * Until NMIX_CommitBatch is called, the calls to NMIX_Play, NMIX_PlayAt,
+ * NMIX_Pause, NMIX_StopAt, NMIX_SetGain, NMIX_SetPan, NMIX_FadeGain,
+ * NMIX_SweepPan, NMIX_SetFilter, NMIX_SetReverbSend, NMIX_SetPitch,
+ * NMIX_SetFrequency, NMIX_UpdateEmitters, NMIX_SeekSource and
+ * NMIX_Crossfade are not applied: they are recorded, and will all be
+ * applied together by the audio thread at the beginning of the same audio
+ * buffer. This is a lot cheaper than locking the mixer for every call, and
+ * guarantees that the changes are heard together:
+ *
+ * \code
+ * NMIX_BeginBatch();
+ * for (int i = 0; i < nb_notes; i++) {
+ *     NMIX_SetGain(notes[i], .3);
+ *     NMIX_Play(notes[i]);
+ * }
+ * NMIX_CommitBatch();
+ * \endcode
+ *
+ * Because the changes are deferred, the getters (NMIX_GetGain,
+ * NMIX_IsPlaying, etc) return the old values until the batch is applied, and
+ * the errors detected when applying the changes (eg. playing a source which
+ * is already playing) are ignored. A batch should be built from a single
+ * thread.
+ *
+ * \sa NMIX_CommitBatch
+ */
+void NMIX_BeginBatch(void);
+
+/**
+ * \fn int NMIX_CommitBatch(void)
+ * \brief Sends a batch of source changes to the audio thread.
+ *
+ * The mixer is locked only once, whatever the size of the batch.
+ *
+ *   \return zero on success, -1 on error (in which case the batch is
+ *           discarded). You can retrieve the error message with a call to
+ *           SDL_GetError()
+ *
+ * \sa NMIX_BeginBatch
+ */
+int NMIX_CommitBatch(void);
+
+/**
+ * \fn NMIX_Mixer* NMIX_GetDefaultMixer(void)
+ * \brief Returns the default mixer, opened by NMIX_OpenAudio.
+ *
+ *   \return The default mixer, NULL if NMIX_OpenAudio hasn't been called
+ *
+ * \sa NMIX_OpenAudio
+ */
+NMIX_Mixer* NMIX_GetDefaultMixer(void);
+
+/**
+ * \fn NMIX_Mixer* NMIX_OpenMixer(const char* device, int rate, int samples)
+ * \brief Creates a mixer that plays on an audio device.
+ *
+ * The parameters are the same as NMIX_OpenAudio.
+ *
+ *    \param device A UTF-8 string reported by SDL_GetAudioDeviceName() (or
+ *                  NULL to get the most reasonable default)
+ *    \param rate The sampling rate (samples per second)
+ *    \param samples Audio buffer size in sample frames
+ *   \return The new mixer, NULL on error. You can retrieve the error message
+ *           with a call to SDL_GetError()
+ *
+ * \sa NMIX_FreeMixer
+ */
+NMIX_Mixer* NMIX_OpenMixer(const char* device, int rate, int samples);
+
+/**
+ * \fn NMIX_Mixer* NMIX_NewMixer(int rate, int samples)
+ * \brief Creates a mixer that isn't attached to an audio device.
+ *
+ * The audio of this mixer is produced by calling NMIX_MixerRender, for
+ * example to render sounds offline. It doesn't require the SDL audio
+ * subsystem.
+ *
+ *    \param rate The sampling rate (samples per second)
+ *    \param samples The size (in sample frames) of the buffers that will
+ *           usually be rendered, used to size the source buffers
+ *   \return The new mixer, NULL on error. You can retrieve the error message
+ *           with a call to SDL_GetError()
+ *
+ * \sa NMIX_MixerRender
+ * \sa NMIX_FreeMixer
+ */
+NMIX_Mixer* NMIX_NewMixer(int rate, int samples);
+
+/**
+ * \fn void NMIX_FreeMixer(NMIX_Mixer* mixer)
+ * \brief Frees a mixer, closing its audio device if it has one.
+ *
+ * The sources of the mixer that are not freed yet stop playing: they can
+ * only be freed afterwards (see NMIX_FreeSource).
+ *
+ *    \param mixer The mixer to free
+ *
+ * \sa NMIX_OpenMixer
+ * \sa NMIX_NewMixer
+ */
+void NMIX_FreeMixer(NMIX_Mixer* mixer);
+
+/**
+ * \fn int NMIX_MixerRender(NMIX_Mixer* mixer, void* buffer, int len)
+ * \brief Mixes all the sources of a mixer into a buffer.
+ *
+ * The buffer is filled with stereo AUDIO_F32SYS samples (LRLRLR ordering),
+ * at the rate of the mixer. This is only allowed for mixers created with
+ * NMIX_NewMixer.
+ *
+ *    \param mixer The mixer to render
+ *    \param buffer The buffer to fill
+ *    \param len The length of the buffer in bytes
+ *   \return zero on success, -1 on error. You can retrieve the error message
+ *           with a call to SDL_GetError()
+ *
+ * \sa NMIX_NewMixer
+ */
+int NMIX_MixerRender(NMIX_Mixer* mixer, void* buffer, int len);
+
+/**
+ * \fn void NMIX_LockMixer(NMIX_Mixer* mixer)
+ * \brief Locks a mixer, preventing it from mixing.
+ *
+ * This is the NMIX_Mixer equivalent of SDL_LockAudioDevice: it must be used
+ * to modify data that is read by a source callback.
+ *
+ *    \param mixer The mixer to lock
+ *
+ * \sa NMIX_TryLockMixer
+ * \sa NMIX_UnlockMixer
+ */
+void NMIX_LockMixer(NMIX_Mixer* mixer);
+
+/**
+ * \fn int NMIX_TryLockMixer(NMIX_Mixer* mixer)
+ * \brief Tries to lock a mixer, without waiting if it is mixing.
+ *
+ *    \param mixer The mixer to lock
+ *   \return zero if the mixer is locked, SDL_MUTEX_TIMEDOUT if it is used
+ *           by another thread, -1 on error
+ *
+ * \sa NMIX_LockMixer
+ * \sa NMIX_UnlockMixer
+ */
+int NMIX_TryLockMixer(NMIX_Mixer* mixer);
+
+/**
+ * \fn void NMIX_UnlockMixer(NMIX_Mixer* mixer)
+ * \brief Unlocks a mixer locked with NMIX_LockMixer.
+ *
+ *    \param mixer The mixer to unlock
+ *
+ * \sa NMIX_LockMixer
+ */
+void NMIX_UnlockMixer(NMIX_Mixer* mixer);
+
+/**
+ * \fn NMIX_Source* NMIX_NewMixerSource(NMIX_Mixer* mixer,
+ *         SDL_AudioFormat format, Uint8 channels, int rate,
+ *         NMIX_SourceCallback callback, void* userdata)
+ * \brief Creates a new NMIX_Source played by a given mixer.
+ *
+ * Same as NMIX_NewSource, for a mixer other than the default one.
+ *
+ * \sa NMIX_NewSource
+ */
+NMIX_Source* NMIX_NewMixerSource(NMIX_Mixer* mixer, SDL_AudioFormat format,
+    Uint8 channels, int rate, NMIX_SourceCallback callback, void* userdata);
+
+/**
+ * \fn NMIX_Source* NMIX_NewMixerLendSource(NMIX_Mixer* mixer,
+ *         SDL_AudioFormat format, Uint8 channels, int rate,
+ *         NMIX_SourceLendCallback lend, void* userdata)
+ * \brief Creates a new NMIX_Source lending its data, played by a given mixer.
+ *
+ * Same as NMIX_NewLendSource, for a mixer other than the default one.
+ *
+ * \sa NMIX_NewLendSource
+ */
+NMIX_Source* NMIX_NewMixerLendSource(NMIX_Mixer* mixer,
+    SDL_AudioFormat format, Uint8 channels, int rate,
+    NMIX_SourceLendCallback lend, void* userdata);
+
+/**
+ * \fn NMIX_Source* NMIX_NewMixerOscillator(NMIX_Mixer* mixer,
+ *         NMIX_Waveform waveform, float frequency)
+ * \brief Same as NMIX_NewOscillator, for a mixer other than the default
+ *        one.
+ */
+NMIX_Source* NMIX_NewMixerOscillator(
+    NMIX_Mixer* mixer, NMIX_Waveform waveform, float frequency);
+
+/**
+ * \fn NMIX_Source* NMIX_NewMixerWavetable(NMIX_Mixer* mixer,
+ *         const float* table, int size, float frequency)
+ * \brief Same as NMIX_NewWavetable, for a mixer other than the default one.
+ */
+NMIX_Source* NMIX_NewMixerWavetable(
+    NMIX_Mixer* mixer, const float* table, int size, float frequency);
+
+/**
+ * \fn void NMIX_MixerPausePlayback(NMIX_Mixer* mixer, SDL_bool pause_on)
+ * \brief Same as NMIX_PausePlayback, for a given mixer.
+ */
+void NMIX_MixerPausePlayback(NMIX_Mixer* mixer, SDL_bool pause_on);
+
+/**
+ * \fn float NMIX_MixerGetGain(NMIX_Mixer* mixer)
+ * \brief Same as NMIX_GetMasterGain, for a given mixer.
+ */
+float NMIX_MixerGetGain(NMIX_Mixer* mixer);
+
+/**
+ * \fn void NMIX_MixerSetGain(NMIX_Mixer* mixer, float gain)
+ * \brief Same as NMIX_SetMasterGain, for a given mixer.
+ */
+void NMIX_MixerSetGain(NMIX_Mixer* mixer, float gain);
+
+/**
+ * \fn void NMIX_MixerGetLevels(NMIX_Mixer* mixer, NMIX_Levels* levels)
+ * \brief Same as NMIX_GetMasterLevels, for a given mixer.
+ */
+void NMIX_MixerGetLevels(NMIX_Mixer* mixer, NMIX_Levels* levels);
+
+/**
+ * \fn SDL_bool NMIX_MixerGetDither(NMIX_Mixer* mixer)
+ * \brief Same as NMIX_GetDither, for a given mixer.
+ */
+SDL_bool NMIX_MixerGetDither(NMIX_Mixer* mixer);
+
+/**
+ * \fn void NMIX_MixerSetDither(NMIX_Mixer* mixer, SDL_bool dither)
+ * \brief Same as NMIX_SetDither, for a given mixer.
+ */
+void NMIX_MixerSetDither(NMIX_Mixer* mixer, SDL_bool dither);
+
+/**
+ * \fn int NMIX_MixerPollEvent(NMIX_Mixer* mixer, NMIX_Event* event)
+ * \brief Same as NMIX_PollEvent, for a given mixer.
+ */
+int NMIX_MixerPollEvent(NMIX_Mixer* mixer, NMIX_Event* event);
+
+/**
+ * \fn int NMIX_MixerStartRenderAhead(NMIX_Mixer* mixer, int blocks,
+ *                                     int block_frames)
+ * \brief Same as NMIX_StartRenderAhead, for a given mixer.
+ *
+ * Only the mixers opened with NMIX_OpenMixer can render ahead.
+ */
+int NMIX_MixerStartRenderAhead(
+    NMIX_Mixer* mixer, int blocks, int block_frames);
+
+/**
+ * \fn int NMIX_MixerStopRenderAhead(NMIX_Mixer* mixer)
+ * \brief Same as NMIX_StopRenderAhead, for a given mixer.
+ */
+int NMIX_MixerStopRenderAhead(NMIX_Mixer* mixer);
+
+/**
+ * \fn int NMIX_MixerGetRenderAheadFill(NMIX_Mixer* mixer)
+ * \brief Same as NMIX_GetRenderAheadFill, for a given mixer.
+ */
+int NMIX_MixerGetRenderAheadFill(NMIX_Mixer* mixer);
+
+/**
+ * \fn int NMIX_MixerGetUnderruns(NMIX_Mixer* mixer)
+ * \brief Same as NMIX_GetUnderruns, for a given mixer.
+ */
+int NMIX_MixerGetUnderruns(NMIX_Mixer* mixer);
+
+/**
+ * \fn int NMIX_MixerStartCapture(NMIX_Mixer* mixer, SDL_RWops* dst,
+ *                                 NMIX_CaptureFormat format, int freedst)
+ * \brief Same as NMIX_StartCapture, for a given mixer.
+ *
+ * The capture of a mixer is stopped when it is freed.
+ */
+int NMIX_MixerStartCapture(NMIX_Mixer* mixer, SDL_RWops* dst,
+    NMIX_CaptureFormat format, int freedst);
+
+/**
+ * \fn int NMIX_MixerStopCapture(NMIX_Mixer* mixer)
+ * \brief Same as NMIX_StopCapture, for a given mixer.
+ */
+int NMIX_MixerStopCapture(NMIX_Mixer* mixer);
+
+/**
+ * \fn int NMIX_MixerGetCaptureDropped(NMIX_Mixer* mixer)
+ * \brief Same as NMIX_GetCaptureDropped, for a given mixer.
+ */
+int NMIX_MixerGetCaptureDropped(NMIX_Mixer* mixer);
+
+/**
+ * \fn int NMIX_MixerSetFilter(NMIX_Mixer* mixer, NMIX_FilterType type,
+ *                              float cutoff, float q)
+ * \brief Same as NMIX_SetMasterFilter, for a given mixer.
+ */
+int NMIX_MixerSetFilter(
+    NMIX_Mixer* mixer, NMIX_FilterType type, float cutoff, float q);
+
+/**
+ * \fn int NMIX_MixerSetReverb(NMIX_Mixer* mixer, const float* ir,
+ *                              int frames, Uint8 channels)
+ * \brief Same as NMIX_SetReverb, for a given mixer.
+ */
+int NMIX_MixerSetReverb(
+    NMIX_Mixer* mixer, const float* ir, int frames, Uint8 channels);
+
+/**
+ * \fn SDL_AudioSpec* NMIX_MixerGetAudioSpec(NMIX_Mixer* mixer)
+ * \brief Same as NMIX_GetAudioSpec, for a given mixer.
+ */
+SDL_AudioSpec* NMIX_MixerGetAudioSpec(NMIX_Mixer* mixer);
+
+/**
+ * \fn SDL_AudioDeviceID NMIX_MixerGetAudioDevice(NMIX_Mixer* mixer)
+ * \brief Same as NMIX_GetAudioDevice, for a given mixer (0 if the mixer has
+ *        no audio device).
+ */
+SDL_AudioDeviceID NMIX_MixerGetAudioDevice(NMIX_Mixer* mixer);
+
+/**
+ * \fn Uint64 NMIX_MixerGetTime(NMIX_Mixer* mixer)
+ * \brief Same as NMIX_GetTime, for a given mixer.
+ */
+Uint64 NMIX_MixerGetTime(NMIX_Mixer* mixer);
+
+/**
+ * \fn void NMIX_MixerBeginBatch(NMIX_Mixer* mixer)
+ * \brief Same as NMIX_BeginBatch, for a given mixer.
+ */
+void NMIX_MixerBeginBatch(NMIX_Mixer* mixer);
+
+/**
+ * \fn int NMIX_MixerCommitBatch(NMIX_Mixer* mixer)
+ * \brief Same as NMIX_CommitBatch, for a given mixer.
+ */
+int NMIX_MixerCommitBatch(NMIX_Mixer* mixer);
+
+/**
+ * \fn float NMIX_MixerGetVirtualThreshold(NMIX_Mixer* mixer)
+ * \brief Same as NMIX_GetVirtualThreshold, for a given mixer.
+ */
+float NMIX_MixerGetVirtualThreshold(NMIX_Mixer* mixer);
+
+/**
+ * \fn void NMIX_MixerSetVirtualThreshold(NMIX_Mixer* mixer, float gain)
+ * \brief Same as NMIX_SetVirtualThreshold, for a given mixer.
+ */
+void NMIX_MixerSetVirtualThreshold(NMIX_Mixer* mixer, float gain);
+
+/**
+ * \fn int NMIX_MixerGetMaxVoices(NMIX_Mixer* mixer)
+ * \brief Same as NMIX_GetMaxVoices, for a given mixer.
+ */
+int NMIX_MixerGetMaxVoices(NMIX_Mixer* mixer);
+
+/**
+ * \fn void NMIX_MixerSetMaxVoices(NMIX_Mixer* mixer, int count)
+ * \brief Same as NMIX_SetMaxVoices, for a given mixer.
+ */
+void NMIX_MixerSetMaxVoices(NMIX_Mixer* mixer, int count);
+
 #endif // SDL_NMIX_H
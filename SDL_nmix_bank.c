@@ -0,0 +1,504 @@
+#include "SDL_nmix_bank.h"
+
+// banks are mapped in memory where the samples can be read as they are in
+// the file (the file is little-endian), and loaded elsewhere
+#if SDL_BYTEORDER == SDL_LIL_ENDIAN && defined(_WIN32)
+#define NMIX_BANK_MMAP_WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#elif SDL_BYTEORDER == SDL_LIL_ENDIAN && \
+    (defined(__unix__) || defined(__APPLE__))
+#define NMIX_BANK_MMAP_POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define NMIX_BANK_MAGIC "NMIXBANK"
+#define NMIX_BANK_VERSION 1
+#define NMIX_BANK_HEADER_SIZE 32
+#define NMIX_BANK_ENTRY_SIZE 64
+
+// alignment (in bytes) of the samples of the entries in the file
+#define NMIX_BANK_ALIGN 64
+
+struct NMIX_Bank {
+  int rate;
+  int count;
+  NMIX_BankEntry* entries;
+  Uint8* data; // the whole file, mapped or loaded
+  size_t size;
+  SDL_bool mapped;
+};
+
+static Uint32 read_le32(const Uint8* p) {
+  Uint32 value;
+  SDL_memcpy(&value, p, sizeof(value));
+  return SDL_SwapLE32(value);
+}
+
+static Uint64 read_le64(const Uint8* p) {
+  Uint64 value;
+  SDL_memcpy(&value, p, sizeof(value));
+  return SDL_SwapLE64(value);
+}
+
+// returns whether a name fits in an entry, with its terminating NUL
+static SDL_bool terminated(const char* name) {
+  for (int i = 0; i < NMIX_BANK_NAME_SIZE; i++) {
+    if (name[i] == '\0') {
+      return SDL_TRUE;
+    }
+  }
+  return SDL_FALSE;
+}
+
+static Sint64 align_offset(Sint64 offset) {
+  return (offset + NMIX_BANK_ALIGN - 1) / NMIX_BANK_ALIGN * NMIX_BANK_ALIGN;
+}
+
+// reads the header and the entries of the bank in "bank->data", returns -1
+// if the file is not a valid bank
+static int parse_bank(NMIX_Bank* bank) {
+  const Uint8* header = bank->data;
+  if (bank->size < NMIX_BANK_HEADER_SIZE ||
+      SDL_memcmp(header, NMIX_BANK_MAGIC, 8) != 0) {
+    SDL_SetError("Not a sound bank.");
+    return -1;
+  }
+  if (read_le32(header + 8) != NMIX_BANK_VERSION) {
+    SDL_SetError("Unsupported sound bank version %u.",
+        (unsigned) read_le32(header + 8));
+    return -1;
+  }
+
+  Uint32 const rate = read_le32(header + 12);
+  Uint32 const count = read_le32(header + 16);
+  if (rate == 0 || rate > 0x7FFFFFFF ||
+      count > (bank->size - NMIX_BANK_HEADER_SIZE) / NMIX_BANK_ENTRY_SIZE) {
+    SDL_SetError("Corrupted sound bank.");
+    return -1;
+  }
+
+  bank->rate = rate;
+  bank->count = count;
+  bank->entries = SDL_malloc(SDL_max(count, 1) * sizeof(NMIX_BankEntry));
+  if (bank->entries == NULL) {
+    SDL_OutOfMemory();
+    return -1;
+  }
+
+  for (Uint32 i = 0; i < count; i++) {
+    const Uint8* p =
+        bank->data + NMIX_BANK_HEADER_SIZE + i * NMIX_BANK_ENTRY_SIZE;
+    NMIX_BankEntry* entry = &bank->entries[i];
+    Uint64 const offset = read_le64(p + NMIX_BANK_NAME_SIZE);
+    Uint64 const frames = read_le64(p + NMIX_BANK_NAME_SIZE + 8);
+    Uint32 const channels = read_le32(p + NMIX_BANK_NAME_SIZE + 16);
+
+    // the samples must be aligned and inside the file
+    if (!terminated((const char*) p) || (channels != 1 && channels != 2) ||
+        offset % sizeof(float) != 0 || offset > bank->size ||
+        frames > (bank->size - offset) / (channels * sizeof(float))) {
+      SDL_SetError("Corrupted sound bank entry %u.", (unsigned) i);
+      return -1;
+    }
+
+    SDL_memcpy(entry->name, p, NMIX_BANK_NAME_SIZE);
+    entry->samples = (const float*) (bank->data + offset);
+    entry->frames = frames;
+    entry->channels = channels;
+  }
+
+  return 0;
+}
+
+static void free_bank_data(NMIX_Bank* bank) {
+  if (!bank->mapped) {
+    SDL_free(bank->data);
+    return;
+  }
+
+#if defined(NMIX_BANK_MMAP_WIN32)
+  UnmapViewOfFile(bank->data);
+#elif defined(NMIX_BANK_MMAP_POSIX)
+  munmap(bank->data, bank->size);
+#endif
+}
+
+// maps a bank file in memory, returns -1 if it can't be mapped (the file is
+// then loaded)
+static int map_bank(NMIX_Bank* bank, const char* path) {
+#if defined(NMIX_BANK_MMAP_WIN32)
+  WCHAR* wpath = (WCHAR*) SDL_iconv_string(
+      "UTF-16LE", "UTF-8", path, SDL_strlen(path) + 1);
+  if (wpath == NULL) {
+    return -1;
+  }
+  HANDLE file = CreateFileW(wpath, GENERIC_READ, FILE_SHARE_READ, NULL,
+      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  SDL_free(wpath);
+  if (file == INVALID_HANDLE_VALUE) {
+    return -1;
+  }
+
+  LARGE_INTEGER size;
+  HANDLE mapping = NULL;
+  if (GetFileSizeEx(file, &size) && size.QuadPart > 0 &&
+      (Uint64) size.QuadPart <= (size_t) -1) {
+    mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  }
+  CloseHandle(file);
+  if (mapping == NULL) {
+    return -1;
+  }
+
+  // the view keeps the mapping alive
+  bank->data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mapping);
+  if (bank->data == NULL) {
+    return -1;
+  }
+  bank->size = (size_t) size.QuadPart;
+  bank->mapped = SDL_TRUE;
+  return 0;
+#elif defined(NMIX_BANK_MMAP_POSIX)
+  int const fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+
+  struct stat st;
+  void* data = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0 &&
+      (Uint64) st.st_size <= (size_t) -1) {
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (data == MAP_FAILED) {
+    return -1;
+  }
+  bank->data = data;
+  bank->size = st.st_size;
+  bank->mapped = SDL_TRUE;
+  return 0;
+#else
+  (void) bank;
+  (void) path;
+  return -1;
+#endif
+}
+
+// reads the whole bank in memory
+static int read_bank(NMIX_Bank* bank, SDL_RWops* rw) {
+  Sint64 const size = SDL_RWsize(rw);
+  if (size <= 0 || (Uint64) size > (size_t) -1) {
+    SDL_SetError("Can't get the size of the sound bank.");
+    return -1;
+  }
+
+  bank->data = SDL_malloc(size);
+  if (bank->data == NULL) {
+    SDL_OutOfMemory();
+    return -1;
+  }
+  bank->size = size;
+  if (SDL_RWread(rw, bank->data, 1, size) != (size_t) size) {
+    SDL_SetError("Error while reading the sound bank: %s", SDL_GetError());
+    return -1;
+  }
+  return 0;
+}
+
+static NMIX_Bank* new_bank(const char* path, SDL_RWops* rw) {
+  NMIX_Bank* bank = SDL_malloc(sizeof(NMIX_Bank));
+  if (bank == NULL) {
+    SDL_OutOfMemory();
+    if (rw != NULL) {
+      SDL_RWclose(rw);
+    }
+    return NULL;
+  }
+  bank->entries = NULL;
+  bank->data = NULL;
+  bank->size = 0;
+  bank->mapped = SDL_FALSE;
+
+  int result = 0;
+  if (rw == NULL && map_bank(bank, path) != 0) {
+    rw = SDL_RWFromFile(path, "rb");
+    result = rw == NULL ? -1 : 0;
+  }
+  if (rw != NULL) {
+    result = read_bank(bank, rw);
+    SDL_RWclose(rw);
+  }
+  if (result != 0 || parse_bank(bank) != 0) {
+    NMIX_CloseBank(bank);
+    return NULL;
+  }
+
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+  // the samples are converted to the native order (the bank is loaded)
+  for (int i = 0; i < bank->count; i++) {
+    NMIX_BankEntry* entry = &bank->entries[i];
+    float* samples = (float*) entry->samples;
+    for (Sint64 j = 0; j < entry->frames * entry->channels; j++) {
+      samples[j] = SDL_SwapFloatLE(samples[j]);
+    }
+  }
+#endif
+
+  return bank;
+}
+
+NMIX_Bank* NMIX_OpenBank(const char* path) {
+  if (path == NULL) {
+    SDL_SetError("Invalid sound bank path.");
+    return NULL;
+  }
+
+  return new_bank(path, NULL);
+}
+
+NMIX_Bank* NMIX_LoadBank(SDL_RWops* rw) {
+  if (rw == NULL) {
+    SDL_SetError("Invalid sound bank SDL_RWops.");
+    return NULL;
+  }
+
+  return new_bank(NULL, rw);
+}
+
+void NMIX_CloseBank(NMIX_Bank* bank) {
+  if (bank == NULL) {
+    return;
+  }
+
+  free_bank_data(bank);
+  SDL_free(bank->entries);
+  SDL_free(bank);
+}
+
+int NMIX_GetBankRate(NMIX_Bank* bank) {
+  if (bank == NULL) {
+    return 0;
+  }
+
+  return bank->rate;
+}
+
+int NMIX_GetBankCount(NMIX_Bank* bank) {
+  if (bank == NULL) {
+    return 0;
+  }
+
+  return bank->count;
+}
+
+const NMIX_BankEntry* NMIX_GetBankEntry(NMIX_Bank* bank, int index) {
+  if (bank == NULL || index < 0 || index >= bank->count) {
+    return NULL;
+  }
+
+  return &bank->entries[index];
+}
+
+int NMIX_FindBankEntry(NMIX_Bank* bank, const char* name) {
+  if (bank == NULL || name == NULL) {
+    return -1;
+  }
+
+  for (int i = 0; i < bank->count; i++) {
+    if (SDL_strcmp(bank->entries[i].name, name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static SDL_bool write_padding(SDL_RWops* dst, Sint64 size) {
+  static Uint8 const zeros[NMIX_BANK_ALIGN] = {0};
+  return SDL_RWwrite(dst, zeros, 1, size) == (size_t) size;
+}
+
+static SDL_bool write_samples(SDL_RWops* dst, const NMIX_BankEntry* entry) {
+  Sint64 const count = entry->frames * entry->channels;
+#if SDL_BYTEORDER == SDL_LIL_ENDIAN
+  size_t const written =
+      SDL_RWwrite(dst, entry->samples, sizeof(float), count);
+  return written == (size_t) count;
+#else
+  for (Sint64 i = 0; i < count; i++) {
+    float const sample = SDL_SwapFloatLE(entry->samples[i]);
+    if (SDL_RWwrite(dst, &sample, sizeof(float), 1) != 1) {
+      return SDL_FALSE;
+    }
+  }
+  return SDL_TRUE;
+#endif
+}
+
+int NMIX_WriteBank(SDL_RWops* dst, int rate, const NMIX_BankEntry* entries,
+    int count) {
+  if (dst == NULL || rate <= 0 || count < 0 ||
+      (entries == NULL && count > 0)) {
+    SDL_SetError("Invalid sound bank parameters.");
+    return -1;
+  }
+  for (int i = 0; i < count; i++) {
+    if (!terminated(entries[i].name) ||
+        (entries[i].channels != 1 && entries[i].channels != 2) ||
+        entries[i].frames < 0 ||
+        (entries[i].samples == NULL && entries[i].frames > 0)) {
+      SDL_SetError("Invalid sound bank entry %d.", i);
+      return -1;
+    }
+  }
+
+  SDL_bool ok = SDL_RWwrite(dst, NMIX_BANK_MAGIC, 8, 1) == 1 &&
+                SDL_WriteLE32(dst, NMIX_BANK_VERSION) &&
+                SDL_WriteLE32(dst, rate) && SDL_WriteLE32(dst, count) &&
+                write_padding(dst, NMIX_BANK_HEADER_SIZE - 20);
+
+  // the table of entries, then the samples
+  Sint64 offset = align_offset(
+      NMIX_BANK_HEADER_SIZE + (Sint64) count * NMIX_BANK_ENTRY_SIZE);
+  for (int i = 0; i < count && ok; i++) {
+    char name[NMIX_BANK_NAME_SIZE] = {0};
+    SDL_strlcpy(name, entries[i].name, NMIX_BANK_NAME_SIZE);
+    ok = SDL_RWwrite(dst, name, NMIX_BANK_NAME_SIZE, 1) == 1 &&
+         SDL_WriteLE64(dst, offset) && SDL_WriteLE64(dst, entries[i].frames) &&
+         SDL_WriteLE32(dst, entries[i].channels) &&
+         write_padding(dst, NMIX_BANK_ENTRY_SIZE - NMIX_BANK_NAME_SIZE - 20);
+    offset = align_offset(
+        offset + entries[i].frames * entries[i].channels * sizeof(float));
+  }
+
+  Sint64 position =
+      NMIX_BANK_HEADER_SIZE + (Sint64) count * NMIX_BANK_ENTRY_SIZE;
+  for (int i = 0; i < count && ok; i++) {
+    ok = write_padding(dst, align_offset(position) - position) &&
+         write_samples(dst, &entries[i]);
+    position = align_offset(position) +
+               entries[i].frames * entries[i].channels * sizeof(float);
+  }
+
+  if (!ok) {
+    SDL_SetError("Error while writing the sound bank: %s", SDL_GetError());
+    return -1;
+  }
+  return 0;
+}
+
+static int SDLCALL bank_lend(void* userdata, const void** data, int len) {
+  NMIX_BankSource* s = (NMIX_BankSource*) userdata;
+  int const frame_size = s->entry->channels * sizeof(float);
+
+  // the samples are lent right from the bank; at the end, the source loops
+  // (only once, in case the sound is empty) or tells the mixer it ended
+  for (int i = 0; i < 2; i++) {
+    Sint64 const frames = SDL_min(len / frame_size,
+        s->entry->frames - s->position);
+    if (frames > 0) {
+      *data = s->entry->samples + s->position * s->entry->channels;
+      s->position += frames;
+      return frames * frame_size;
+    }
+    if (!s->loop_on || i > 0) {
+      break;
+    }
+    s->position = 0;
+    NMIX_PushEvent(s->source, NMIX_EVENT_LOOPED);
+  }
+  return 0;
+}
+
+static int SDLCALL bank_seek(void* userdata, Sint64 frame) {
+  NMIX_BankSource* s = (NMIX_BankSource*) userdata;
+
+  s->position = SDL_max(SDL_min(frame, s->entry->frames), 0);
+  s->source->eof = SDL_FALSE;
+  return 0;
+}
+
+static int SDLCALL bank_skip(void* userdata, int frames) {
+  NMIX_BankSource* s = (NMIX_BankSource*) userdata;
+  Sint64 const length = s->entry->frames;
+
+  Sint64 position = s->position + frames;
+  int skipped = frames;
+  if (position >= length) {
+    if (s->loop_on && length > 0) {
+      position %= length;
+      NMIX_PushEvent(s->source, NMIX_EVENT_LOOPED);
+    } else {
+      skipped = SDL_max(length - s->position, 0);
+      position = length;
+    }
+  }
+  s->position = position;
+  return skipped;
+}
+
+NMIX_BankSource* NMIX_NewBankSource(NMIX_Bank* bank, int index) {
+  if (NMIX_GetDefaultMixer() == NULL) {
+    SDL_SetError("Please open NMIX device before creating sources.");
+    return NULL;
+  }
+
+  return NMIX_NewMixerBankSource(NMIX_GetDefaultMixer(), bank, index);
+}
+
+NMIX_BankSource* NMIX_NewMixerBankSource(
+    NMIX_Mixer* mixer, NMIX_Bank* bank, int index) {
+  if (mixer == NULL) {
+    SDL_SetError("Please create a mixer before creating sources.");
+    return NULL;
+  }
+  const NMIX_BankEntry* entry = NMIX_GetBankEntry(bank, index);
+  if (entry == NULL) {
+    SDL_SetError("Invalid sound bank entry %d.", index);
+    return NULL;
+  }
+
+  NMIX_BankSource* s = SDL_malloc(sizeof(NMIX_BankSource));
+  if (s == NULL) {
+    SDL_OutOfMemory();
+    return NULL;
+  }
+
+  s->entry = entry;
+  s->position = 0;
+  s->loop_on = SDL_FALSE;
+  s->source = NMIX_NewMixerLendSource(
+      mixer, AUDIO_F32SYS, entry->channels, bank->rate, bank_lend, s);
+  if (s->source == NULL) {
+    SDL_free(s);
+    return NULL;
+  }
+  s->source->seek = bank_seek;
+  s->source->skip = bank_skip;
+
+  return s;
+}
+
+void NMIX_SetBankLoop(NMIX_BankSource* s, SDL_bool loop_on) {
+  if (s == NULL) {
+    return;
+  }
+
+  NMIX_LockMixer(s->source->mixer);
+  s->loop_on = loop_on;
+  NMIX_UnlockMixer(s->source->mixer);
+}
+
+void NMIX_FreeBankSource(NMIX_BankSource* s) {
+  if (s == NULL) {
+    return;
+  }
+
+  NMIX_FreeSource(s->source);
+  SDL_free(s);
+}
@@ -0,0 +1,210 @@
+/** \file SDL_nmix_bank.h */
+
+#ifndef SDL_NMIX_BANK_H
+#define SDL_NMIX_BANK_H
+
+#include "SDL_nmix.h"
+
+/**
+ * \def NMIX_BANK_NAME_SIZE
+ * \brief Size of the name of a bank entry, including the terminating NUL.
+ */
+#define NMIX_BANK_NAME_SIZE 40
+
+/**
+ * \struct NMIX_Bank
+ * \brief A sound bank: a file holding sounds already converted to the
+ *        mixer format.
+ *
+ * A bank is made offline by the nmix_pack tool (see NMIX_WriteBank), which
+ * decodes the sounds with SDL_sound. Opening a bank maps the file in memory
+ * where the platform allows it, so the sounds play without being decoded,
+ * converted or even read before they are needed.
+ *
+ * The layout of the file is (all the values are little-endian):
+ * - a header of 32 bytes: the magic "NMIXBANK", the version (Uint32), the
+ *   sampling rate (Uint32), the number of entries (Uint32), and 12 bytes
+ *   reserved
+ * - the entries, of 64 bytes each: the name (NMIX_BANK_NAME_SIZE bytes),
+ *   the offset of the samples in the file (Uint64), the number of frames
+ *   (Uint64), the number of channels (Uint32), and 4 bytes reserved
+ * - the samples of the entries (interleaved floats), each aligned on 64
+ *   bytes
+ *
+ * \sa NMIX_OpenBank
+ */
+typedef struct NMIX_Bank NMIX_Bank;
+
+/**
+ * \struct NMIX_BankEntry
+ * \brief A sound of a bank.
+ */
+typedef struct NMIX_BankEntry {
+  char name[NMIX_BANK_NAME_SIZE]; /**< Name of the sound. */
+  const float* samples; /**< Interleaved samples of the sound. */
+  Sint64 frames; /**< Length (in sample frames) of the sound. */
+  Uint8 channels; /**< Number of channels of the sound (1 or 2). */
+} NMIX_BankEntry;
+
+/**
+ * \struct NMIX_BankSource
+ * \brief Represents a source that plays a sound of a bank.
+ *
+ * The source reads the samples from the bank without copying them. Every
+ * field in this struct should be considered read-only, you should call
+ * NMIX_* functions to modify the source state.
+ *
+ * \sa NMIX_NewBankSource
+ */
+typedef struct NMIX_BankSource {
+  NMIX_Source* source; /**< The NMIX_Source source. */
+  const NMIX_BankEntry* entry; /**< The sound played. */
+  Sint64 position; /**< Current position (in sample frames) of the source. */
+  SDL_bool loop_on; /**< Whether the source should be looped or not. */
+} NMIX_BankSource;
+
+/**
+ * \fn NMIX_Bank* NMIX_OpenBank(const char* path)
+ * \brief Opens a sound bank file.
+ *
+ * The file is mapped in memory on POSIX systems and on Windows, and loaded
+ * in memory elsewhere (and on big-endian systems, where the samples are
+ * converted).
+ *
+ *    \param path The path of the bank file (in UTF-8)
+ *   \return The bank, NULL on error. You can retrieve the error message
+ *           with a call to SDL_GetError()
+ *
+ * \sa NMIX_LoadBank
+ * \sa NMIX_CloseBank
+ */
+NMIX_Bank* NMIX_OpenBank(const char* path);
+
+/**
+ * \fn NMIX_Bank* NMIX_LoadBank(SDL_RWops* rw)
+ * \brief Loads a sound bank in memory.
+ *
+ * This is used when the bank is not a file that can be mapped, eg when it
+ * is in an archive. The SDL_RWops is closed/freed.
+ *
+ *    \param rw A SDL_RWops that points to the bank
+ *   \return The bank, NULL on error. You can retrieve the error message
+ *           with a call to SDL_GetError()
+ *
+ * \sa NMIX_OpenBank
+ */
+NMIX_Bank* NMIX_LoadBank(SDL_RWops* rw);
+
+/**
+ * \fn void NMIX_CloseBank(NMIX_Bank* bank)
+ * \brief Closes a sound bank.
+ *
+ * The sources playing sounds of the bank must be freed before.
+ *
+ *    \param bank The bank to close
+ */
+void NMIX_CloseBank(NMIX_Bank* bank);
+
+/**
+ * \fn int NMIX_GetBankRate(NMIX_Bank* bank)
+ * \brief Gets the sampling rate of the sounds of a bank.
+ *
+ *    \param bank The bank
+ *   \return The sampling rate, in Hz
+ */
+int NMIX_GetBankRate(NMIX_Bank* bank);
+
+/**
+ * \fn int NMIX_GetBankCount(NMIX_Bank* bank)
+ * \brief Gets the number of sounds in a bank.
+ *
+ *    \param bank The bank
+ *   \return The number of sounds
+ */
+int NMIX_GetBankCount(NMIX_Bank* bank);
+
+/**
+ * \fn const NMIX_BankEntry* NMIX_GetBankEntry(NMIX_Bank* bank, int index)
+ * \brief Gets a sound of a bank.
+ *
+ *    \param bank The bank
+ *    \param index The index of the sound, from 0 to NMIX_GetBankCount() - 1
+ *   \return The sound, valid until the bank is closed, NULL if the index is
+ *           out of range
+ */
+const NMIX_BankEntry* NMIX_GetBankEntry(NMIX_Bank* bank, int index);
+
+/**
+ * \fn int NMIX_FindBankEntry(NMIX_Bank* bank, const char* name)
+ * \brief Finds a sound of a bank by its name.
+ *
+ *    \param bank The bank
+ *    \param name The name of the sound
+ *   \return The index of the sound, -1 if there is none with this name
+ */
+int NMIX_FindBankEntry(NMIX_Bank* bank, const char* name);
+
+/**
+ * \fn int NMIX_WriteBank(SDL_RWops* dst, int rate,
+ *         const NMIX_BankEntry* entries, int count)
+ * \brief Writes a sound bank.
+ *
+ * This is used by the tools that make the banks, see examples/nmix_pack.c.
+ * The sounds must be at the same sampling rate, which should be the rate of
+ * the mixers that play them. The SDL_RWops is not closed.
+ *
+ *    \param dst A SDL_RWops where the bank is written
+ *    \param rate The sampling rate of the sounds
+ *    \param entries The sounds (see NMIX_DecodeFile)
+ *    \param count The number of sounds
+ *   \return zero on success, -1 on error. You can retrieve the error
+ *           message with a call to SDL_GetError()
+ */
+int NMIX_WriteBank(SDL_RWops* dst, int rate, const NMIX_BankEntry* entries,
+    int count);
+
+/**
+ * \fn NMIX_BankSource* NMIX_NewBankSource(NMIX_Bank* bank, int index)
+ * \brief Creates a new NMIX_BankSource.
+ *
+ * The source plays a sound of the bank, which must stay open until the
+ * source is freed. Several sources can play the same sound.
+ *
+ *    \param bank The bank
+ *    \param index The index of the sound (see NMIX_FindBankEntry)
+ *   \return The source, NULL on error. You can retrieve the error message
+ *           with a call to SDL_GetError()
+ *
+ * \sa NMIX_FreeBankSource
+ */
+NMIX_BankSource* NMIX_NewBankSource(NMIX_Bank* bank, int index);
+
+/**
+ * \fn NMIX_BankSource* NMIX_NewMixerBankSource(NMIX_Mixer* mixer,
+ *         NMIX_Bank* bank, int index)
+ * \brief Same as NMIX_NewBankSource, for a mixer other than the default
+ *        one.
+ */
+NMIX_BankSource* NMIX_NewMixerBankSource(
+    NMIX_Mixer* mixer, NMIX_Bank* bank, int index);
+
+/**
+ * \fn void NMIX_SetBankLoop(NMIX_BankSource* s, SDL_bool loop_on)
+ * \brief Sets whether a bank source loops.
+ *
+ * A NMIX_EVENT_LOOPED event is posted each time the source loops.
+ *
+ *    \param s The source
+ *    \param loop_on SDL_TRUE to loop the source, SDL_FALSE otherwise
+ */
+void NMIX_SetBankLoop(NMIX_BankSource* s, SDL_bool loop_on);
+
+/**
+ * \fn void NMIX_FreeBankSource(NMIX_BankSource* s)
+ * \brief Frees a NMIX_BankSource.
+ *
+ *    \param s The source to free
+ */
+void NMIX_FreeBankSource(NMIX_BankSource* s);
+
+#endif // SDL_NMIX_BANK_H
@@ -6,74 +6,1089 @@
 //     return sample->buffer_size;
 // }
 
-static void sdlsound_callback(void* userdata, void* _buffer, int buffer_size) {
+// duration (in milliseconds) of the audio cached at the loop start of a
+// streamed source: it must cover the time the worker takes to seek
+#define NMIX_LOOP_HEAD_MS 250
+
+// default duration (in milliseconds) of the audio decoded by NMIX_SeekAsync
+#define NMIX_PREROLL_MS 100
+
+// default size (in bytes) of the chunks read by the I/O thread, and number
+// of chunks read ahead of the decoder (see NMIX_NewReadAheadRW)
+#define NMIX_READ_AHEAD_CHUNK 65536
+#define NMIX_READ_AHEAD_DEPTH 4
+
+// loudness (in LUFS) measured for a silent sound, which is the absolute gate
+// of ITU-R BS.1770
+#define NMIX_SILENT_LOUDNESS -70.f
+
+// maximum number of threads created by NMIX_LoadFileSources
+#define NMIX_MAX_LOAD_THREADS 31
+
+// the states of the decoder job of a file source
+enum {
+  NMIX_JOB_NONE, // the decoder is used by the audio thread
+  NMIX_JOB_REQUESTED, // NMIX_SeekAsync waits for the decoder to be free
+  NMIX_JOB_PENDING, // the decoder is used by the worker
+  NMIX_JOB_DONE // the data decoded by the worker is in job_buffer
+};
+
+// the kinds of jobs
+enum {
+  NMIX_JOB_LOOP, // decodes the data following the loop head
+  NMIX_JOB_SEEK, // seeks and decodes the preroll (NMIX_SeekAsync)
+  NMIX_JOB_LOOP_HEAD // caches the loop head, then decodes the preroll
+};
+
+// the background thread that seeks the decoders of streamed sources, so
+// that the audio thread and the game thread never wait for SDL_sound to
+// seek. It is shared by all the file sources.
+static struct {
+  SDL_SpinLock init_lock; // protects "users"
+  int users; // number of file sources
+  SDL_Thread* thread;
+  SDL_mutex* lock; // protects the fields below, and job_queued/next_job
+  SDL_cond* wake; // signaled when a job is queued
+  SDL_cond* done; // broadcast when a job is done
+  NMIX_FileSource* jobs; // sources waiting for the worker
+  NMIX_FileSource* current; // source being processed by the worker
+  SDL_bool quit;
+} worker;
+
+static SDL_INLINE int frame_size(NMIX_FileSource* s) {
+  return SDL_AUDIO_SAMPLELEN(s->sample->actual.format) *
+         s->sample->actual.channels;
+}
+
+// makes the decoder of a streamed source read from "frame": "*buffer" and
+// "*bytes" receive the data decoded at this position. Returns -1 on error.
+static int decode_at(
+    NMIX_FileSource* s, Sint64 frame, Uint8** buffer, int* bytes) {
+  Uint32 const rate = s->sample->actual.rate;
+  Uint32 ms = 0;
+  if (frame == 0 || !(s->sample->flags & SOUND_SAMPLEFLAG_CANSEEK)) {
+    // the decoders that can't seek (eg MIDI) can still rewind, and decode
+    // up to "frame"
+    if (Sound_Rewind(s->sample) == 0) {
+      SDL_SetError("Error while rewinding source: %s", Sound_GetError());
+      return -1;
+    }
+  } else {
+    ms = frame * 1000 / rate;
+    if (Sound_Seek(s->sample, ms) == 0) {
+      SDL_SetError("Error while seeking source: %s", Sound_GetError());
+      return -1;
+    }
+  }
+
+  // SDL_sound seeks with a millisecond precision: the frames decoded before
+  // "frame" are dropped
+  Sint64 skip = (frame - (Sint64) ms * rate / 1000) * frame_size(s);
+  *buffer = s->sample->buffer;
+  *bytes = Sound_Decode(s->sample);
+  while (*bytes > 0 && skip >= *bytes) {
+    skip -= *bytes;
+    *bytes = Sound_Decode(s->sample);
+  }
+  if (*bytes > 0) {
+    *buffer += skip;
+    *bytes -= skip;
+  }
+  return 0;
+}
+
+// decodes the data at the loop start of a streamed source, which is played
+// while the worker seeks the decoder. Called by the worker, which then
+// seeks the decoder back to the position of the source.
+static int cache_loop_head(NMIX_FileSource* s) {
+  s->loop_head_size = 0;
+  s->loop_head_complete = SDL_FALSE;
+  s->loop_head_cached = SDL_TRUE;
+  if (s->loop_start > 0 && !(s->sample->flags & SOUND_SAMPLEFLAG_CANSEEK)) {
+    // the decoder would decode the whole file up to the loop start: without
+    // loop head, it rewinds when the source loops
+    SDL_free(s->loop_head);
+    s->loop_head = NULL;
+    return 0;
+  }
+
+  int const frame_bytes = frame_size(s);
+  int capacity = NMIX_LOOP_HEAD_MS * s->sample->actual.rate / 1000;
+  if (s->loop_end >= 0 && s->loop_end - s->loop_start <= capacity) {
+    capacity = SDL_max(s->loop_end - s->loop_start, 0);
+    s->loop_head_complete = SDL_TRUE;
+  }
+  capacity *= frame_bytes;
+
+  if (s->loop_head == NULL) {
+    int const size = NMIX_LOOP_HEAD_MS * s->sample->actual.rate / 1000;
+    s->loop_head = SDL_malloc(SDL_max(size, 1) * frame_bytes);
+    if (s->loop_head == NULL) {
+      s->loop_head_cached = SDL_FALSE;
+      return -1;
+    }
+  }
+
+  Uint8* data;
+  int bytes;
+  int result = decode_at(s, s->loop_start, &data, &bytes);
+  while (result == 0 && s->loop_head_size < capacity) {
+    if (bytes == 0) {
+      s->loop_head_complete = SDL_TRUE;
+      break;
+    }
+    int const size = SDL_min(bytes, capacity - s->loop_head_size);
+    SDL_memcpy(s->loop_head + s->loop_head_size, data, size);
+    s->loop_head_size += size;
+    if (s->loop_head_size < capacity) {
+      data = s->sample->buffer;
+      bytes = Sound_Decode(s->sample);
+    }
+  }
+
+  if (result != 0) {
+    // the source seeks when it loops
+    s->loop_head_size = 0;
+    s->loop_head_complete = SDL_FALSE;
+    s->loop_head_cached = SDL_FALSE;
+  }
+  return result;
+}
+
+// decodes the data of a job, called by the worker
+static void run_job(NMIX_FileSource* s) {
+  Uint8* data;
+  int bytes;
+
+  s->job_buffer = s->sample->buffer;
+  s->job_bytes = 0;
+  int const cached =
+      s->job_kind == NMIX_JOB_LOOP_HEAD ? cache_loop_head(s) : 0;
+  int const decoded = decode_at(s, s->job_frame, &data, &bytes);
+  if (s->job_kind != NMIX_JOB_LOOP) {
+    s->job_result = cached != 0 || decoded != 0 ? -1 : 0;
+  }
+  if (decoded != 0) {
+    return;
+  }
+  if (s->job_kind == NMIX_JOB_LOOP) {
+    s->job_buffer = data;
+    s->job_bytes = bytes;
+    return;
+  }
+
+  // after a seek, the preroll is decoded ahead, so that the first buffers
+  // don't wait for the decoder. Whole chunks are copied, the decoder is
+  // then right after the preroll.
+  s->job_buffer = s->preroll;
+  while (bytes > 0) {
+    int const size = SDL_min(bytes, s->preroll_capacity - s->job_bytes);
+    SDL_memcpy(s->preroll + s->job_bytes, data, size);
+    s->job_bytes += size;
+    if (s->job_bytes >= s->preroll_size || size < bytes) {
+      break;
+    }
+    data = s->sample->buffer;
+    bytes = Sound_Decode(s->sample);
+  }
+}
+
+// adds a source to the job queue, the worker lock must be held
+static void queue_source(NMIX_FileSource* s) {
+  if (s->job_queued) {
+    return;
+  }
+
+  s->job_queued = SDL_TRUE;
+  s->next_job = NULL;
+  NMIX_FileSource** last = &worker.jobs;
+  while (*last != NULL) {
+    last = &(*last)->next_job;
+  }
+  *last = s;
+  SDL_CondSignal(worker.wake);
+}
+
+// whether a source has a seek (NMIX_SeekAsync) or loop head request
+static SDL_bool has_request(NMIX_FileSource* s) {
+  return SDL_AtomicGet(&s->seek_request) >= 0 ||
+         SDL_AtomicGet(&s->loop_head_request) != 0;
+}
+
+// asks the worker to serve the requests of a source, the worker lock must
+// be held
+static void post_request(NMIX_FileSource* s) {
+  for (;;) {
+    int const state = SDL_AtomicGet(&s->job_state);
+    if (state == NMIX_JOB_REQUESTED || state == NMIX_JOB_PENDING) {
+      // the request will be seen once the decoder is free
+      return;
+    }
+    if (SDL_AtomicCAS(&s->job_state, state, NMIX_JOB_REQUESTED)) {
+      queue_source(s);
+      return;
+    }
+  }
+}
+
+static int SDLCALL sdlsound_seek(void* userdata, Sint64 frame) {
+  NMIX_FileSource* s = (NMIX_FileSource*) userdata;
+
+  frame = SDL_max(frame, 0);
+  s->source->eof = SDL_FALSE;
+  s->position = frame;
+
+  if (s->predecoded) {
+    // the whole file is in memory: seeking only moves the cursor, to the
+    // exact frame
+    Sint64 const length = s->sample->buffer_size / frame_size(s);
+    s->position = SDL_min(frame, length);
+    s->buffer = (Uint8*) s->sample->buffer + s->position * frame_size(s);
+    s->bytes_left = (length - s->position) * frame_size(s);
+    return 0;
+  }
+
+  // this seek replaces the ones made with NMIX_SeekAsync (the mixer is
+  // locked, so the worker can't claim the decoder meanwhile). A loop head
+  // request is kept, the worker decodes from the new position.
+  SDL_AtomicSet(&s->seek_request, -1);
+  if (SDL_AtomicGet(&s->loop_head_request) == 0) {
+    SDL_AtomicCAS(&s->job_state, NMIX_JOB_REQUESTED, NMIX_JOB_NONE);
+  }
+  s->awaiting_preroll = SDL_FALSE;
+
+  // the decoder may be used by the worker: it seeks when the source is
+  // mixed again, and the data decoded before the seek must not be played
+  s->bytes_left = 0;
+  s->in_loop_head = SDL_FALSE;
+  s->seek_pending = SDL_TRUE;
+
+  return 0;
+}
+
+// serves the requests of a source: a predecoded source seeks right away,
+// the decoder of a streamed source is given to the worker. The mixer must be
+// locked: the audio thread is then not using the data of the source.
+static void claim_decoder(NMIX_FileSource* s) {
+  SDL_bool const loop_head = SDL_AtomicGet(&s->loop_head_request) != 0;
+  int const ms = SDL_AtomicSet(&s->seek_request, -1);
+  if ((ms < 0 && !loop_head) || s->predecoded) {
+    SDL_AtomicSet(&s->loop_head_request, 0);
+    SDL_AtomicSet(&s->job_state, NMIX_JOB_NONE);
+    if (ms >= 0) {
+      sdlsound_seek(s, (Sint64) ms * s->sample->actual.rate / 1000);
+    }
+    return;
+  }
+
+  // the source is silent until the preroll is decoded
+  s->bytes_left = 0;
+  s->in_loop_head = SDL_FALSE;
+  s->seek_pending = SDL_FALSE;
+  s->awaiting_preroll = SDL_TRUE;
+
+  // without seek request, the source resumes at its position once the
+  // loop head is cached
+  s->job_kind = loop_head ? NMIX_JOB_LOOP_HEAD : NMIX_JOB_SEEK;
+  s->job_ms = ms;
+  s->job_frame = s->position;
+  if (ms >= 0) {
+    s->job_frame = (Sint64) ms * s->sample->actual.rate / 1000;
+  }
+  SDL_AtomicSet(&s->job_state, NMIX_JOB_PENDING);
+  SDL_AtomicSet(&s->loop_head_request, 0);
+}
+
+static int SDLCALL worker_thread(void* data) {
+  (void) data;
+
+  SDL_LockMutex(worker.lock);
+  while (!worker.quit) {
+    NMIX_FileSource* s = worker.jobs;
+    if (s == NULL) {
+      SDL_CondWait(worker.wake, worker.lock);
+      continue;
+    }
+    worker.jobs = s->next_job;
+    s->job_queued = SDL_FALSE;
+    worker.current = s;
+    SDL_UnlockMutex(worker.lock);
+
+    // a seek request waits for the mixer, which is tried without waiting:
+    // a thread may wait for this worker while holding the mixer
+    if (SDL_AtomicGet(&s->job_state) == NMIX_JOB_REQUESTED &&
+        NMIX_TryLockMixer(s->source->mixer) == 0) {
+      if (SDL_AtomicGet(&s->job_state) == NMIX_JOB_REQUESTED) {
+        claim_decoder(s);
+      }
+      NMIX_UnlockMixer(s->source->mixer);
+    }
+
+    int const state = SDL_AtomicGet(&s->job_state);
+    if (state == NMIX_JOB_PENDING) {
+      // the audio thread doesn't use the decoder until the job is done
+      run_job(s);
+    }
+
+    SDL_LockMutex(worker.lock);
+    int const now = SDL_AtomicGet(&s->job_state);
+    if (state == NMIX_JOB_PENDING) {
+      SDL_AtomicSet(&s->job_state, NMIX_JOB_DONE);
+      // NMIX_SeekAsync was called again during the job
+      if (has_request(s)) {
+        post_request(s);
+      }
+    } else if (now == NMIX_JOB_REQUESTED || now == NMIX_JOB_PENDING) {
+      // the mixer was busy (or the audio thread claimed the decoder
+      // meanwhile), we try again
+      if (now == NMIX_JOB_REQUESTED) {
+        SDL_UnlockMutex(worker.lock);
+        SDL_Delay(1);
+        SDL_LockMutex(worker.lock);
+      }
+      // unless cancel_job dropped the request meanwhile
+      int const again = SDL_AtomicGet(&s->job_state);
+      if (again == NMIX_JOB_REQUESTED || again == NMIX_JOB_PENDING) {
+        queue_source(s);
+      }
+    }
+    worker.current = NULL;
+    SDL_CondBroadcast(worker.done);
+  }
+  SDL_UnlockMutex(worker.lock);
+
+  return 0;
+}
+
+// starts the worker if no file source uses it yet
+static int acquire_worker(void) {
+  int result = 0;
+
+  SDL_AtomicLock(&worker.init_lock);
+  if (worker.users == 0) {
+    worker.jobs = NULL;
+    worker.current = NULL;
+    worker.quit = SDL_FALSE;
+    worker.lock = SDL_CreateMutex();
+    worker.wake = SDL_CreateCond();
+    worker.done = SDL_CreateCond();
+    worker.thread = NULL;
+    if (worker.lock != NULL && worker.wake != NULL && worker.done != NULL) {
+      worker.thread =
+          SDL_CreateThread(worker_thread, "SDL_nmix decoder", NULL);
+    }
+    if (worker.thread == NULL) {
+      SDL_DestroyCond(worker.done);
+      SDL_DestroyCond(worker.wake);
+      SDL_DestroyMutex(worker.lock);
+      result = -1;
+    }
+  }
+  if (result == 0) {
+    worker.users++;
+  }
+  SDL_AtomicUnlock(&worker.init_lock);
+
+  return result;
+}
+
+// stops the worker once no file source uses it
+static void release_worker(void) {
+  SDL_AtomicLock(&worker.init_lock);
+  worker.users--;
+  if (worker.users == 0) {
+    SDL_LockMutex(worker.lock);
+    worker.quit = SDL_TRUE;
+    SDL_CondSignal(worker.wake);
+    SDL_UnlockMutex(worker.lock);
+
+    SDL_WaitThread(worker.thread, NULL);
+    SDL_DestroyCond(worker.done);
+    SDL_DestroyCond(worker.wake);
+    SDL_DestroyMutex(worker.lock);
+  }
+  SDL_AtomicUnlock(&worker.init_lock);
+}
+
+// asks the worker to decode the data following the loop head, called from
+// the audio thread. Returns SDL_FALSE if the decoder is not free.
+static SDL_bool queue_loop_job(NMIX_FileSource* s, Sint64 frame) {
+  int const state = SDL_AtomicGet(&s->job_state);
+  if (state != NMIX_JOB_NONE && state != NMIX_JOB_DONE) {
+    return SDL_FALSE;
+  }
+
+  s->job_kind = NMIX_JOB_LOOP;
+  s->job_frame = frame;
+  if (!SDL_AtomicCAS(&s->job_state, state, NMIX_JOB_PENDING)) {
+    return SDL_FALSE;
+  }
+
+  SDL_LockMutex(worker.lock);
+  queue_source(s);
+  SDL_UnlockMutex(worker.lock);
+  return SDL_TRUE;
+}
+
+// takes the data decoded by the worker, returns SDL_FALSE if the job is not
+// done
+static SDL_bool take_job(NMIX_FileSource* s) {
+  return SDL_AtomicCAS(&s->job_state, NMIX_JOB_DONE, NMIX_JOB_NONE);
+}
+
+// drops the job of a source, unless the worker is using the source: then
+// it returns SDL_FALSE, the mixer must be unlocked while the worker decodes
+// (see lock_cancel_job). The seek request is kept. The mixer must be locked.
+static SDL_bool cancel_job(NMIX_FileSource* s) {
+  SDL_LockMutex(worker.lock);
+  // a request not served yet is dropped: the worker would retry it forever,
+  // as it can't lock the mixer
+  SDL_AtomicCAS(&s->job_state, NMIX_JOB_REQUESTED, NMIX_JOB_NONE);
+  if (worker.current == s) {
+    SDL_UnlockMutex(worker.lock);
+    return SDL_FALSE;
+  }
+  if (s->job_queued) {
+    NMIX_FileSource** job = &worker.jobs;
+    while (*job != s) {
+      job = &(*job)->next_job;
+    }
+    *job = s->next_job;
+    s->job_queued = SDL_FALSE;
+  }
+  SDL_AtomicSet(&s->job_state, NMIX_JOB_NONE);
+  if (s->awaiting_preroll) {
+    // the seek (or the loop head) was not heard yet: it is requested again
+    if (s->job_ms >= 0) {
+      SDL_AtomicCAS(&s->seek_request, -1, s->job_ms);
+    }
+    if (s->job_kind == NMIX_JOB_LOOP_HEAD) {
+      SDL_AtomicSet(&s->loop_head_request, 1);
+    }
+    s->awaiting_preroll = SDL_FALSE;
+  }
+  SDL_UnlockMutex(worker.lock);
+
+  return SDL_TRUE;
+}
+
+// locks the mixer of a source and drops its job (see cancel_job). The
+// worker is waited for with the mixer unlocked, so that the audio thread
+// keeps playing while it decodes.
+static void lock_cancel_job(NMIX_FileSource* s) {
+  NMIX_Mixer* const mixer = s->source->mixer;
+  NMIX_LockMixer(mixer);
+  while (!cancel_job(s)) {
+    NMIX_UnlockMixer(mixer);
+    SDL_LockMutex(worker.lock);
+    while (worker.current == s) {
+      SDL_CondWait(worker.done, worker.lock);
+    }
+    SDL_UnlockMutex(worker.lock);
+    NMIX_LockMixer(mixer);
+  }
+}
+
+// posts the requests kept by cancel_job
+static void repost_request(NMIX_FileSource* s) {
+  if (has_request(s)) {
+    SDL_LockMutex(worker.lock);
+    post_request(s);
+    SDL_UnlockMutex(worker.lock);
+  }
+}
+
+// posts the requests of a source and waits until the worker served them,
+// returns the result of the job. The calling thread must not lock the mixer:
+// the audio thread keeps playing the other sources meanwhile.
+static int wait_job(NMIX_FileSource* s) {
+  SDL_LockMutex(worker.lock);
+  post_request(s);
+  for (;;) {
+    int const state = SDL_AtomicGet(&s->job_state);
+    if (!has_request(s) && state != NMIX_JOB_REQUESTED &&
+        state != NMIX_JOB_PENDING) {
+      break;
+    }
+    SDL_CondWait(worker.done, worker.lock);
+  }
+  int const result = s->job_result;
+  SDL_UnlockMutex(worker.lock);
+
+  return result;
+}
+
+// asks the worker to cache the loop head of a streamed source, and waits
+// for it
+static int request_loop_head(NMIX_FileSource* s) {
+  SDL_AtomicSet(&s->loop_head_request, 1);
+  if (wait_job(s) != 0) {
+    SDL_SetError("Cannot decode the loop start of the source.");
+    return -1;
+  }
+  return 0;
+}
+
+// moves a looped source back to its loop start
+static void wrap_loop(NMIX_FileSource* s) {
+  if (s->predecoded) {
+    Sint64 const length = s->sample->buffer_size / frame_size(s);
+    Sint64 const start = SDL_min(s->loop_start, length);
+    s->buffer = (Uint8*) s->sample->buffer + start * frame_size(s);
+    s->bytes_left = (length - start) * frame_size(s);
+    s->position = start;
+    return;
+  }
+
+  s->position = s->loop_start;
+  s->bytes_left = 0;
+  s->in_loop_head = SDL_FALSE;
+  s->seek_pending = SDL_FALSE;
+  if (s->loop_head == NULL ||
+      (!s->loop_head_complete &&
+          !queue_loop_job(
+              s, s->loop_start + s->loop_head_size / frame_size(s)))) {
+    // no cached data, or the decoder is used by the worker: the decoder
+    // seeks to the loop start
+    s->seek_pending = SDL_TRUE;
+    return;
+  }
+
+  // the cached data is played while the worker seeks the decoder to the
+  // end of it
+  s->buffer = s->loop_head;
+  s->bytes_left = s->loop_head_size;
+  s->in_loop_head = SDL_TRUE;
+}
+
+// lends silence while the worker prepares the data of a source: the whole
+// request is filled, so that the data is swapped in at the beginning of a
+// chunk
+static int lend_silence(NMIX_FileSource* s, const void** data, int len) {
+  *data = s->silence;
+  return SDL_min(len, s->silence_size);
+}
+
+// continues a source with its preroll, returns SDL_FALSE if the worker has
+// not decoded it yet
+static SDL_bool take_preroll(NMIX_FileSource* s) {
+  if (!take_job(s)) {
+    return SDL_FALSE;
+  }
+  s->awaiting_preroll = SDL_FALSE;
+  s->buffer = s->job_buffer;
+  s->bytes_left = s->job_bytes;
+  s->position = s->job_frame;
+  s->source->eof = SDL_FALSE;
+  return SDL_TRUE;
+}
+
+// serves the seek request of a source, at the beginning of a chunk
+static void serve_request(NMIX_FileSource* s) {
+  if (SDL_AtomicGet(&s->job_state) == NMIX_JOB_REQUESTED) {
+    claim_decoder(s);
+  }
+}
+
+static int SDLCALL sdlsound_lend(void* userdata, const void** data, int len) {
   NMIX_FileSource* s = (NMIX_FileSource*) userdata;
-  Uint8* buffer = (Uint8*) _buffer;
 
-  // SDL_sound uses an internal buffer "s->sample->buffer" with a fixed size
-  // "s->sample->buffer_size", so we keep track of "where we are at" in
-  // the buffer using the pointer "s->buffer".
-  // The variable "s->bytes_left" represents the number of bytes left
-  // to read in the SDL_sound internal buffer.
-
-  int bytes_written = 0;
-  while (bytes_written < buffer_size) {
-    // we calculate how many bytes we should copy
-    int copy_size = buffer_size - bytes_written;
-    if (copy_size > s->bytes_left) {
-      copy_size = s->bytes_left;
-    }
-
-    // we copy "copy_size" bytes to the buffer and advance our pointer
-    SDL_memcpy(buffer + bytes_written, s->buffer, copy_size);
-    s->bytes_left -= copy_size;
-    s->buffer += copy_size;
-    bytes_written += copy_size;
-
-    // if we copied all bytes from the internal buffer, we try to fetch
-    // more data
-    if (s->bytes_left == 0) {
-      // we reset the buffer pointer + bytes_left values
-      s->bytes_left = s->sample->buffer_size;
-      s->buffer = s->sample->buffer;
-
-      // we check if we have reached EOF and set the flag accordingly
-      if (s->predecoded) {
-        // if the source is predecoded, 0 bytes left means we're at EOF
-        s->source->eof = SDL_TRUE;
-      } else {
-        // if the source is streamed, we check EOF with SDL_sound
-        // if we're not at EOF, we decode more data
-        if ((s->sample->flags & SOUND_SAMPLEFLAG_EOF) ||
-            (s->sample->flags & SOUND_SAMPLEFLAG_EAGAIN)) {
-          s->source->eof = SDL_TRUE;
-        } else {
-          s->bytes_left = Sound_Decode(s->sample);
-        }
-      }
+  // SDL_sound uses an internal buffer "s->sample->buffer" with a fixed size
+  // "s->sample->buffer_size", which is lent to the mixer: we keep track of
+  // "where we are at" in the buffer using the pointer "s->buffer".
+  // The variable "s->bytes_left" represents the number of bytes left
+  // to lend from the SDL_sound internal buffer (or from the loop head, or
+  // from the preroll).
+
+  serve_request(s);
+
+  SDL_bool looped = SDL_FALSE;
+  for (;;) {
+    if (s->bytes_left > 0) {
+      // we lend at most "len" bytes (up to the loop end) and advance our
+      // pointer
+      Sint64 size = SDL_min(len, s->bytes_left);
+      if (s->loop_on && s->loop_end >= 0) {
+        size = SDL_min(size, (s->loop_end - s->position) * frame_size(s));
+      }
+      if (size > 0) {
+        *data = s->buffer;
+        s->bytes_left -= size;
+        s->buffer += size;
+        s->position += size / frame_size(s);
+        return size;
+      }
+    } else if (s->awaiting_preroll) {
+      // the source was seeked with NMIX_SeekAsync: it continues with the
+      // preroll once decoded
+      if (!take_preroll(s)) {
+        return lend_silence(s, data, len);
+      }
+      if (s->bytes_left > 0) {
+        continue;
+      }
+    } else if (s->in_loop_head) {
+      // the loop head was played: the source continues with the data
+      // decoded by the worker
+      if (!s->loop_head_complete) {
+        if (!take_job(s)) {
+          return lend_silence(s, data, len);
+        }
+        s->in_loop_head = SDL_FALSE;
+        s->buffer = s->job_buffer;
+        s->bytes_left = s->job_bytes;
+        if (s->bytes_left > 0) {
+          continue;
+        }
+      }
+      s->in_loop_head = SDL_FALSE;
+    } else if (!s->predecoded) {
+      // the decoder is still used by the worker (the source moved since
+      // the job was queued, so the data it decodes is dropped)
+      int const state = SDL_AtomicGet(&s->job_state);
+      if (state == NMIX_JOB_REQUESTED || state == NMIX_JOB_PENDING ||
+          (state == NMIX_JOB_DONE && !take_job(s))) {
+        return lend_silence(s, data, len);
+      }
+
+      // the source was skipped or seeked: the decoder catches up now that
+      // the data is needed
+      if (s->seek_pending) {
+        s->seek_pending = SDL_FALSE;
+        if (decode_at(s, s->position, &s->buffer, &s->bytes_left) != 0) {
+          return 0;
+        }
+        continue;
+      }
+
+      // if we're not at EOF, we decode more data
+      if (!(s->sample->flags & SOUND_SAMPLEFLAG_EOF) &&
+          !(s->sample->flags & SOUND_SAMPLEFLAG_EAGAIN)) {
+        s->buffer = s->sample->buffer;
+        s->bytes_left = Sound_Decode(s->sample);
+        if (s->bytes_left > 0) {
+          continue;
+        }
+      }
+    }
+
+    // if we are at EOF (or at the loop end), we either loop (only once, in
+    // case the loop is empty) or tell the mixer that the source ended
+    if (!s->loop_on || looped) {
+      return 0;
+    }
+    wrap_loop(s);
+    looped = SDL_TRUE;
+    NMIX_PushEvent(s->source, NMIX_EVENT_LOOPED);
+  }
+}
+
+static int SDLCALL sdlsound_skip(void* userdata, int frames) {
+  NMIX_FileSource* s = (NMIX_FileSource*) userdata;
+
+  // a source waiting for its preroll stays at the same position
+  serve_request(s);
+  if (s->awaiting_preroll && !take_preroll(s)) {
+    return frames;
+  }
+
+  Sint64 length = s->length;
+  if (s->predecoded) {
+    length = s->sample->buffer_size / frame_size(s);
+  }
+  Sint64 end = length;
+  if (s->loop_on && s->loop_end >= 0 && (end < 0 || s->loop_end < end)) {
+    end = s->loop_end;
+  }
+
+  // finding the new position, wrapping around if the source is looped
+  Sint64 position = s->position + frames;
+  int skipped = frames;
+  SDL_bool looped = SDL_FALSE;
+  if (end >= 0 && position >= end) {
+    if (s->loop_on && end > s->loop_start) {
+      position = s->loop_start +
+                 (position - s->loop_start) % (end - s->loop_start);
+      looped = SDL_TRUE;
+    } else {
+      skipped = SDL_max(end - s->position, 0);
+      position = end;
+    }
+  }
+
+  Sint64 const offset = (position - s->position) * frame_size(s);
+  Sint64 const head_offset = (position - s->loop_start) * frame_size(s);
+  if (s->predecoded) {
+    s->buffer = (Uint8*) s->sample->buffer + position * frame_size(s);
+    s->bytes_left = (length - position) * frame_size(s);
+  } else if (looped && s->loop_head != NULL &&
+             head_offset <= s->loop_head_size) {
+    // the new position is in the cached loop head
+    wrap_loop(s);
+    if (s->in_loop_head) {
+      s->buffer += head_offset;
+      s->bytes_left -= head_offset;
+    }
+  } else if (!looped && !s->seek_pending && offset <= s->bytes_left) {
+    // the new position is in the data already decoded
+    s->buffer += offset;
+    s->bytes_left -= offset;
+  } else {
+    // seeking is deferred until the source is mixed again
+    s->seek_pending = SDL_TRUE;
+    s->in_loop_head = SDL_FALSE;
+    s->bytes_left = 0;
+  }
+  s->position = position;
+  if (looped) {
+    NMIX_PushEvent(s->source, NMIX_EVENT_LOOPED);
+  }
+
+  return skipped;
+}
+
+// the state of a SDL_RWops made by NMIX_NewReadAheadRW: a ring of "depth"
+// chunks, filled by the I/O thread with the data following the position of
+// the reader
+typedef struct NMIX_ReadAhead {
+  SDL_RWops* rw; // the wrapped SDL_RWops, used by the I/O thread
+  Sint64 size; // size of the file, -1 if unknown
+  Uint8* buffer;
+  int chunk_size;
+  int capacity; // size of the buffer, "depth" chunks
+  SDL_atomic_t stalls;
+  Sint64 file_position; // position of "rw", used by the I/O thread
+
+  // protected by io.lock
+  Sint64 offset; // position in the file of the data at "head"
+  int head; // position of the reader in the buffer
+  int filled; // number of bytes available to the reader
+  Uint32 generation; // incremented when the reader moves out of the buffer
+  SDL_bool eof; // set once the I/O thread reached the end of the file
+  struct NMIX_ReadAhead* next; // next stream served by the I/O thread
+} NMIX_ReadAhead;
+
+// the background thread that reads the files of the streams made by
+// NMIX_NewReadAheadRW. It is shared by all the streams.
+static struct {
+  SDL_SpinLock init_lock; // protects "users"
+  int users; // number of streams
+  SDL_Thread* thread;
+  SDL_mutex* lock; // protects the fields below, and the state of the streams
+  SDL_cond* wake; // signaled when a stream has room for a chunk
+  SDL_cond* done; // broadcast when a chunk is read
+  NMIX_ReadAhead* streams;
+  NMIX_ReadAhead* current; // stream being read by the I/O thread
+  SDL_bool quit;
+} io;
+
+// returns the stream that is the least filled, and has room for a chunk
+static NMIX_ReadAhead* next_stream(void) {
+  NMIX_ReadAhead* best = NULL;
+  for (NMIX_ReadAhead* r = io.streams; r != NULL; r = r->next) {
+    if (!r->eof && r->capacity - r->filled >= r->chunk_size &&
+        (best == NULL || r->filled < best->filled)) {
+      best = r;
+    }
+  }
+  return best;
+}
+
+static int SDLCALL io_thread(void* data) {
+  (void) data;
+
+  SDL_LockMutex(io.lock);
+  while (!io.quit) {
+    NMIX_ReadAhead* r = next_stream();
+    if (r == NULL) {
+      SDL_CondWait(io.wake, io.lock);
+      continue;
+    }
+
+    // the chunk is read outside of the lock, after the data available to
+    // the reader (which doesn't touch the rest of the buffer)
+    Uint32 const generation = r->generation;
+    Sint64 const position = r->offset + r->filled;
+    int const tail = (r->head + r->filled) % r->capacity;
+    int const size = SDL_min(r->chunk_size, r->capacity - tail);
+    io.current = r;
+    SDL_UnlockMutex(io.lock);
+
+    size_t read = 0;
+    if (r->file_position == position ||
+        SDL_RWseek(r->rw, position, RW_SEEK_SET) == position) {
+      read = SDL_RWread(r->rw, r->buffer + tail, 1, size);
+      r->file_position = position + read;
+    } else {
+      r->file_position = -1;
+    }
+
+    SDL_LockMutex(io.lock);
+    // the data is dropped if the reader moved meanwhile
+    if (r->generation == generation) {
+      r->filled += (int) read;
+      r->eof = read == 0;
+    }
+    io.current = NULL;
+    SDL_CondBroadcast(io.done);
+  }
+  SDL_UnlockMutex(io.lock);
+
+  return 0;
+}
+
+// starts the I/O thread if no stream uses it yet
+static int acquire_io(void) {
+  int result = 0;
+
+  SDL_AtomicLock(&io.init_lock);
+  if (io.users == 0) {
+    io.streams = NULL;
+    io.current = NULL;
+    io.quit = SDL_FALSE;
+    io.lock = SDL_CreateMutex();
+    io.wake = SDL_CreateCond();
+    io.done = SDL_CreateCond();
+    io.thread = NULL;
+    if (io.lock != NULL && io.wake != NULL && io.done != NULL) {
+      io.thread = SDL_CreateThread(io_thread, "SDL_nmix I/O", NULL);
+    }
+    if (io.thread == NULL) {
+      SDL_DestroyCond(io.done);
+      SDL_DestroyCond(io.wake);
+      SDL_DestroyMutex(io.lock);
+      result = -1;
+    }
+  }
+  if (result == 0) {
+    io.users++;
+  }
+  SDL_AtomicUnlock(&io.init_lock);
+
+  return result;
+}
+
+// stops the I/O thread once no stream uses it
+static void release_io(void) {
+  SDL_AtomicLock(&io.init_lock);
+  io.users--;
+  if (io.users == 0) {
+    SDL_LockMutex(io.lock);
+    io.quit = SDL_TRUE;
+    SDL_CondSignal(io.wake);
+    SDL_UnlockMutex(io.lock);
+
+    SDL_WaitThread(io.thread, NULL);
+    SDL_DestroyCond(io.done);
+    SDL_DestroyCond(io.wake);
+    SDL_DestroyMutex(io.lock);
+  }
+  SDL_AtomicUnlock(&io.init_lock);
+}
+
+static Sint64 SDLCALL read_ahead_size(SDL_RWops* context) {
+  NMIX_ReadAhead* r = (NMIX_ReadAhead*) context->hidden.unknown.data1;
+  return r->size;
+}
+
+static Sint64 SDLCALL read_ahead_seek(
+    SDL_RWops* context, Sint64 offset, int whence) {
+  NMIX_ReadAhead* r = (NMIX_ReadAhead*) context->hidden.unknown.data1;
+
+  SDL_LockMutex(io.lock);
+  Sint64 position = offset;
+  if (whence == RW_SEEK_CUR) {
+    position += r->offset;
+  } else if (whence == RW_SEEK_END) {
+    position = r->size >= 0 ? r->size + offset : -1;
+  }
+  if (position < 0) {
+    SDL_UnlockMutex(io.lock);
+    return SDL_SetError("Invalid seek in read-ahead stream.");
+  }
+
+  if (position >= r->offset && position <= r->offset + r->filled) {
+    // the new position is in the data already read
+    int const skipped = (int) (position - r->offset);
+    r->head = (r->head + skipped) % r->capacity;
+    r->filled -= skipped;
+  } else {
+    // the I/O thread starts reading at the new position
+    r->head = 0;
+    r->filled = 0;
+    r->eof = SDL_FALSE;
+    r->generation++;
+  }
+  r->offset = position;
+  SDL_CondSignal(io.wake);
+  SDL_UnlockMutex(io.lock);
+
+  return position;
+}
+
+static size_t SDLCALL read_ahead_read(
+    SDL_RWops* context, void* ptr, size_t size, size_t maxnum) {
+  NMIX_ReadAhead* r = (NMIX_ReadAhead*) context->hidden.unknown.data1;
+  Uint8* dst = ptr;
+  size_t const total = size * maxnum;
+  size_t done = 0;
+  SDL_bool stalled = SDL_FALSE;
+
+  SDL_LockMutex(io.lock);
+  while (done < total) {
+    if (r->filled > 0) {
+      size_t const count = SDL_min(
+          SDL_min((size_t) r->filled, total - done),
+          (size_t) (r->capacity - r->head));
+      SDL_memcpy(dst + done, r->buffer + r->head, count);
+      r->head = (r->head + count) % r->capacity;
+      r->filled -= count;
+      r->offset += count;
+      done += count;
+      SDL_CondSignal(io.wake);
+    } else if (r->eof) {
+      break;
+    } else {
+      // the data is not read yet: the reader waits for the I/O thread
+      if (!stalled) {
+        SDL_AtomicIncRef(&r->stalls);
+        stalled = SDL_TRUE;
+      }
+      SDL_CondSignal(io.wake);
+      SDL_CondWait(io.done, io.lock);
+    }
+  }
+  SDL_UnlockMutex(io.lock);
+
+  return size > 0 ? done / size : 0;
+}
+
+static size_t SDLCALL read_ahead_write(
+    SDL_RWops* context, const void* ptr, size_t size, size_t num) {
+  (void) context;
+  (void) ptr;
+  (void) size;
+  (void) num;
+  SDL_SetError("Read-ahead streams are read-only.");
+  return 0;
+}
+
+static int SDLCALL read_ahead_close(SDL_RWops* context) {
+  NMIX_ReadAhead* r = (NMIX_ReadAhead*) context->hidden.unknown.data1;
+
+  SDL_LockMutex(io.lock);
+  NMIX_ReadAhead** stream = &io.streams;
+  while (*stream != r) {
+    stream = &(*stream)->next;
+  }
+  *stream = r->next;
+  while (io.current == r) {
+    SDL_CondWait(io.done, io.lock);
+  }
+  SDL_UnlockMutex(io.lock);
+  release_io();
+
+  int const result = SDL_RWclose(r->rw);
+  SDL_free(r->buffer);
+  SDL_free(r);
+  SDL_FreeRW(context);
+  return result;
+}
+
+SDL_RWops* NMIX_NewReadAheadRW(SDL_RWops* rw, int chunk_size, int depth) {
+  if (rw == NULL || chunk_size < 0 || depth < 0) {
+    SDL_SetError("Invalid read-ahead parameters.");
+    return NULL;
+  }
+  if (chunk_size == 0) {
+    chunk_size = NMIX_READ_AHEAD_CHUNK;
+  }
+  if (depth == 0) {
+    depth = NMIX_READ_AHEAD_DEPTH;
+  }
+  if (depth > SDL_MAX_SINT32 / chunk_size) {
+    SDL_SetError("Read-ahead buffer too large.");
+    return NULL;
+  }
+
+  Sint64 const start = SDL_RWtell(rw);
+  NMIX_ReadAhead* r = SDL_malloc(sizeof(NMIX_ReadAhead));
+  SDL_RWops* context = SDL_AllocRW();
+  Uint8* buffer = SDL_malloc(chunk_size * depth);
+  if (r == NULL || context == NULL || buffer == NULL) {
+    SDL_free(r);
+    SDL_free(buffer);
+    if (context != NULL) {
+      SDL_FreeRW(context);
+    }
+    SDL_OutOfMemory();
+    return NULL;
+  }
+  if (acquire_io() != 0) {
+    SDL_free(r);
+    SDL_free(buffer);
+    SDL_FreeRW(context);
+    SDL_SetError("Can't start the read-ahead thread: %s", SDL_GetError());
+    return NULL;
+  }
+
+  r->rw = rw;
+  r->size = SDL_RWsize(rw);
+  r->buffer = buffer;
+  r->chunk_size = chunk_size;
+  r->capacity = chunk_size * depth;
+  SDL_AtomicSet(&r->stalls, 0);
+  r->offset = SDL_max(start, 0);
+  r->file_position = start;
+  r->head = 0;
+  r->filled = 0;
+  r->generation = 0;
+  r->eof = SDL_FALSE;
+
+  context->size = read_ahead_size;
+  context->seek = read_ahead_seek;
+  context->read = read_ahead_read;
+  context->write = read_ahead_write;
+  context->close = read_ahead_close;
+  context->type = SDL_RWOPS_UNKNOWN;
+  context->hidden.unknown.data1 = r;
+
+  // the I/O thread starts reading right away
+  SDL_LockMutex(io.lock);
+  r->next = io.streams;
+  io.streams = r;
+  SDL_CondSignal(io.wake);
+  SDL_UnlockMutex(io.lock);
+
+  return context;
+}
 
-      // if we are at EOF, we either rewind it (if loop is on)
-      // or set all remaining bytes of buffer to silence
-      if (s->source->eof) {
-        if (s->loop_on) {
-          NMIX_Rewind(s);
-        } else {
-          // set all remaining bytes to silence (0) and return
-          SDL_memset(buffer + bytes_written, 0, buffer_size - bytes_written);
-          break;
-        }
-      }
-    }
+int NMIX_GetReadAheadStalls(SDL_RWops* rw) {
+  if (rw == NULL || rw->close != read_ahead_close) {
+    return 0;
   }
+
+  NMIX_ReadAhead* r = (NMIX_ReadAhead*) rw->hidden.unknown.data1;
+  return SDL_AtomicGet(&r->stalls);
 }
 
 NMIX_FileSource* NMIX_NewFileSource(
     SDL_RWops* rw, const char* ext, SDL_bool predecode) {
-  if (NMIX_GetAudioDevice() == 0) {
+  if (NMIX_GetDefaultMixer() == NULL) {
     SDL_SetError("Please open NMIX device before creating sources.");
     return NULL;
   }
 
+  return NMIX_NewMixerFileSource(NMIX_GetDefaultMixer(), rw, ext, predecode);
+}
+
+NMIX_FileSource* NMIX_NewMixerFileSource(
+    NMIX_Mixer* mixer, SDL_RWops* rw, const char* ext, SDL_bool predecode) {
+  if (mixer == NULL) {
+    SDL_SetError("Please create a mixer before creating sources.");
+    return NULL;
+  }
+
   NMIX_FileSource* s = SDL_malloc(sizeof(NMIX_FileSource));
   if (s == NULL) {
     SDL_OutOfMemory();
@@ -83,7 +1098,7 @@ NMIX_FileSource* NMIX_NewFileSource(
   s->rw = rw;
   s->ext = ext;
 
-  SDL_AudioSpec* spec = NMIX_GetAudioSpec();
+  SDL_AudioSpec* spec = NMIX_MixerGetAudioSpec(mixer);
 
   s->sample = Sound_NewSample(s->rw, s->ext, NULL, spec->size);
   if (s->sample == NULL) {
@@ -92,25 +1107,75 @@ NMIX_FileSource* NMIX_NewFileSource(
     return NULL;
   }
 
-  s->source = NMIX_NewSource(s->sample->actual.format,
-      s->sample->actual.channels, s->sample->actual.rate, sdlsound_callback, s);
+  s->source = NMIX_NewMixerLendSource(mixer, s->sample->actual.format,
+      s->sample->actual.channels, s->sample->actual.rate, sdlsound_lend, s);
   if (s->source == NULL) {
     Sound_FreeSample(s->sample);
     SDL_free(s);
     return NULL;
   }
+  s->source->seek = sdlsound_seek;
+  s->source->skip = sdlsound_skip;
 
   s->buffer = s->sample->buffer;
   s->bytes_left = 0;
+  s->position = 0;
+  s->seek_pending = SDL_FALSE;
+
+  s->length = -1;
+  Sint32 duration = Sound_GetDuration(s->sample);
+  if (duration >= 0) {
+    s->length = (Sint64) duration * s->sample->actual.rate / 1000;
+  }
 
   s->loop_on = SDL_FALSE;
+  s->loop_start = 0;
+  s->loop_end = -1;
+  s->loop_head = NULL;
+  s->loop_head_size = 0;
+  s->loop_head_complete = SDL_FALSE;
+  s->loop_head_cached = SDL_FALSE;
+  s->in_loop_head = SDL_FALSE;
+  s->silence = NULL;
+  s->silence_size = 0;
+  s->preroll = NULL;
+  s->preroll_size = 0;
+  s->preroll_capacity = 0;
+  s->awaiting_preroll = SDL_FALSE;
+
+  SDL_AtomicSet(&s->seek_request, -1);
+  SDL_AtomicSet(&s->loop_head_request, 0);
+  SDL_AtomicSet(&s->job_state, NMIX_JOB_NONE);
+  s->job_result = 0;
+  s->job_queued = SDL_FALSE;
+  s->next_job = NULL;
+
+  if (acquire_worker() != 0) {
+    NMIX_FreeSource(s->source);
+    Sound_FreeSample(s->sample);
+    SDL_free(s);
+    return NULL;
+  }
 
+  NMIX_Analysis const analysis = {0.f, 0.f, 1.f, 0, 0};
+  s->analysis = analysis;
   s->predecoded = predecode;
   if (predecode) {
     // we predecode the whole file: Sound_DecodeAll will resize
     // its internal buffer and store all data inside.
     s->bytes_left = Sound_DecodeAll(s->sample);
     s->buffer = s->sample->buffer;
+  } else {
+    // the silence fills a whole request of the mixer
+    s->silence_size = s->source->in_buffer_size;
+    s->silence = SDL_malloc(s->silence_size);
+    if (s->silence == NULL || NMIX_SetPreroll(s, NMIX_PREROLL_MS) != 0) {
+      NMIX_FreeFileSource(s);
+      SDL_OutOfMemory();
+      return NULL;
+    }
+    SDL_memset(s->silence, s->sample->actual.format == AUDIO_U8 ? 0x80 : 0,
+        s->silence_size);
   }
 
   return s;
@@ -120,6 +1185,9 @@ Sint32 NMIX_GetDuration(NMIX_FileSource* s) {
   if (s == NULL) {
     return -1;
   }
+  if (s->analysis.trimmed_start > 0 || s->analysis.trimmed_end > 0) {
+    return (Sint32) (s->length * 1000 / s->sample->actual.rate);
+  }
 
   return Sound_GetDuration(s->sample);
 }
@@ -129,34 +1197,98 @@ int NMIX_Seek(NMIX_FileSource* s, int ms) {
     return -1;
   }
 
-  if (Sound_Seek(s->sample, ms) == 0) {
-    SDL_SetError("Error while seeking source: %s", Sound_GetError());
+  Sint64 frame = (Sint64) ms * s->sample->actual.rate / 1000;
+  return NMIX_SeekSource(s->source, frame);
+}
+
+int NMIX_SeekAsync(NMIX_FileSource* s, int ms) {
+  if (s == NULL) {
     return -1;
   }
 
+  SDL_AtomicSet(&s->seek_request, SDL_max(ms, 0));
+  SDL_LockMutex(worker.lock);
+  post_request(s);
+  SDL_UnlockMutex(worker.lock);
+
   return 0;
 }
 
-int NMIX_Rewind(NMIX_FileSource* s) {
+int NMIX_GetPreroll(NMIX_FileSource* s) {
+  if (s == NULL || s->predecoded) {
+    return 0;
+  }
+
+  return (Sint64) s->preroll_size / frame_size(s) * 1000 /
+         s->sample->actual.rate;
+}
+
+int NMIX_SetPreroll(NMIX_FileSource* s, int ms) {
   if (s == NULL) {
     return -1;
   }
+  if (s->predecoded) {
+    return 0;
+  }
 
-  SDL_LockAudioDevice(NMIX_GetAudioDevice());
-  s->source->eof = SDL_FALSE;
-  s->bytes_left = 0;
-  s->buffer = s->sample->buffer;
+  // whole chunks of the decoder are copied in the preroll
+  int const size =
+      (Sint64) SDL_max(ms, 0) * s->sample->actual.rate / 1000 * frame_size(s);
+  int const capacity = size + s->sample->buffer_size;
+
+  lock_cancel_job(s);
+  if (s->bytes_left > 0 && !s->in_loop_head) {
+    // the data played may be in the preroll
+    s->bytes_left = 0;
+    s->seek_pending = SDL_TRUE;
+  }
+  Uint8* preroll = SDL_realloc(s->preroll, capacity);
+  if (preroll != NULL) {
+    s->preroll = preroll;
+    s->preroll_size = size;
+    s->preroll_capacity = capacity;
+  }
+  repost_request(s);
+  NMIX_UnlockMixer(s->source->mixer);
+
+  if (preroll == NULL) {
+    SDL_OutOfMemory();
+    return -1;
+  }
+  return 0;
+}
+
+Sint64 NMIX_GetPosition(NMIX_FileSource* s) {
+  if (s == NULL) {
+    return -1;
+  }
+
+  NMIX_LockMixer(s->source->mixer);
+  Sint64 position = s->position;
+  NMIX_UnlockMixer(s->source->mixer);
+
+  return position;
+}
+
+int NMIX_Rewind(NMIX_FileSource* s) {
+  if (s == NULL) {
+    return -1;
+  }
 
   if (s->predecoded) {
-    s->bytes_left = s->sample->buffer_size;
-  } else {
-    if (Sound_Rewind(s->sample) == 0) {
-      SDL_SetError("Error while rewinding source: %s", Sound_GetError());
-      SDL_UnlockAudioDevice(NMIX_GetAudioDevice());
-      return -1;
-    }
+    NMIX_LockMixer(s->source->mixer);
+    sdlsound_seek(s, 0);
+    NMIX_UnlockMixer(s->source->mixer);
+    return 0;
+  }
+
+  // the worker rewinds the decoder and decodes the preroll, as for
+  // NMIX_SeekAsync
+  SDL_AtomicSet(&s->seek_request, 0);
+  if (wait_job(s) != 0) {
+    SDL_SetError("Error while rewinding source.");
+    return -1;
   }
-  SDL_UnlockAudioDevice(NMIX_GetAudioDevice());
   return 0;
 }
 
@@ -168,12 +1300,579 @@ SDL_bool NMIX_GetLoop(NMIX_FileSource* s) {
   return s->loop_on;
 }
 
-void NMIX_SetLoop(NMIX_FileSource* s, SDL_bool loop_on) {
+int NMIX_SetLoop(NMIX_FileSource* s, SDL_bool loop_on) {
   if (s == NULL) {
-    return;
+    return -1;
   }
 
+  NMIX_LockMixer(s->source->mixer);
   s->loop_on = loop_on;
+  NMIX_UnlockMixer(s->source->mixer);
+
+  // if the loop head can't be cached, the decoder seeks on the audio thread
+  // when the source loops
+  if (loop_on && !s->predecoded && !s->loop_head_cached) {
+    return request_loop_head(s);
+  }
+  return 0;
+}
+
+int NMIX_SetLoopPoints(NMIX_FileSource* s, Sint64 start, Sint64 end) {
+  if (s == NULL) {
+    return -1;
+  }
+  if (start < 0 || (end >= 0 && end <= start) || end < -1) {
+    SDL_SetError("Invalid loop points");
+    return -1;
+  }
+
+  NMIX_LockMixer(s->source->mixer);
+  s->loop_start = start;
+  s->loop_end = end;
+  if (!s->predecoded) {
+    // the cached data is dropped: until the worker decodes it again, the
+    // source waits for the worker when it loops
+    s->loop_head_size = 0;
+    s->loop_head_complete = SDL_FALSE;
+    s->loop_head_cached = SDL_FALSE;
+  }
+  NMIX_UnlockMixer(s->source->mixer);
+
+  if (s->loop_on && !s->predecoded) {
+    return request_loop_head(s);
+  }
+  return 0;
+}
+
+void NMIX_GetLoopPoints(NMIX_FileSource* s, Sint64* start, Sint64* end) {
+  if (s == NULL) {
+    return;
+  }
+
+  if (start != NULL) {
+    *start = s->loop_start;
+  }
+  if (end != NULL) {
+    *end = s->loop_end;
+  }
+}
+
+// whether decoded data in "format" must be byte-swapped to be read
+static SDL_bool swapped(SDL_AudioFormat format) {
+  SDL_bool const big = SDL_AUDIO_ISBIGENDIAN(format) ? SDL_TRUE : SDL_FALSE;
+  return big != (SDL_BYTEORDER == SDL_BIG_ENDIAN);
+}
+
+// reads the sample "i" of decoded data, in any format, as a float
+static float load_sample(const Uint8* data, SDL_AudioFormat format, Sint64 i) {
+  switch (SDL_AUDIO_BITSIZE(format)) {
+    case 8:
+      if (SDL_AUDIO_ISSIGNED(format)) {
+        return ((const Sint8*) data)[i] / 128.f;
+      }
+      return (data[i] - 128) / 128.f;
+    case 16: {
+      Uint16 v = ((const Uint16*) data)[i];
+      if (swapped(format)) {
+        v = SDL_Swap16(v);
+      }
+      if (SDL_AUDIO_ISSIGNED(format)) {
+        return (Sint16) v / 32768.f;
+      }
+      return (v - 32768) / 32768.f;
+    }
+    default: {
+      Uint32 v = ((const Uint32*) data)[i];
+      if (swapped(format)) {
+        v = SDL_Swap32(v);
+      }
+      if (SDL_AUDIO_ISFLOAT(format)) {
+        float f;
+        SDL_memcpy(&f, &v, sizeof(f));
+        return f;
+      }
+      return (float) ((Sint32) v / 2147483648.0);
+    }
+  }
+}
+
+// writes the sample "i" of decoded data, in any format, from a float
+static void store_sample(
+    Uint8* data, SDL_AudioFormat format, Sint64 i, float x) {
+  if (!SDL_AUDIO_ISFLOAT(format)) {
+    x = SDL_max(-1.f, SDL_min(x, 1.f));
+  }
+  switch (SDL_AUDIO_BITSIZE(format)) {
+    case 8:
+      if (SDL_AUDIO_ISSIGNED(format)) {
+        ((Sint8*) data)[i] = (Sint8) SDL_min(x * 128.f, 127.f);
+      } else {
+        data[i] = (Uint8) (SDL_min(x * 128.f, 127.f) + 128.f);
+      }
+      break;
+    case 16: {
+      Sint16 const s = (Sint16) SDL_min(x * 32768.f, 32767.f);
+      Uint16 v = SDL_AUDIO_ISSIGNED(format) ? (Uint16) s : (Uint16) (s + 32768);
+      if (swapped(format)) {
+        v = SDL_Swap16(v);
+      }
+      ((Uint16*) data)[i] = v;
+      break;
+    }
+    default: {
+      Uint32 v;
+      if (SDL_AUDIO_ISFLOAT(format)) {
+        SDL_memcpy(&v, &x, sizeof(v));
+      } else {
+        v = (Uint32) (Sint32) SDL_min(x * 2147483648.0, 2147483647.0);
+      }
+      if (swapped(format)) {
+        v = SDL_Swap32(v);
+      }
+      ((Uint32*) data)[i] = v;
+      break;
+    }
+  }
+}
+
+// a biquad filter of the K-weighting, in direct form I
+typedef struct NMIX_Biquad {
+  double b0, b1, b2, a1, a2;
+  double x1, x2, y1, y2;
+} NMIX_Biquad;
+
+static double biquad(NMIX_Biquad* f, double x) {
+  double const y =
+      f->b0 * x + f->b1 * f->x1 + f->b2 * f->x2 - f->a1 * f->y1 - f->a2 * f->y2;
+  f->x2 = f->x1;
+  f->x1 = x;
+  f->y2 = f->y1;
+  f->y1 = y;
+  return y;
+}
+
+// sets the two stages of the K-weighting of ITU-R BS.1770 (a high shelf
+// that models the head, then a high-pass) for any sampling rate, with the
+// filter parameters fitted by libebur128 to the coefficients of the
+// standard
+static void k_weighting(NMIX_Biquad* shelf, NMIX_Biquad* high_pass, int rate) {
+  double const pi = 3.14159265358979323846;
+
+  double const vh = SDL_pow(10.0, 3.999843853973347 / 20.0);
+  double const vb = SDL_pow(vh, 0.4996667741545416);
+  double k = SDL_tan(pi * 1681.974450955533 / rate);
+  double q = 0.7071752369554196;
+  double a0 = 1.0 + k / q + k * k;
+  SDL_zerop(shelf);
+  shelf->b0 = (vh + vb * k / q + k * k) / a0;
+  shelf->b1 = 2.0 * (k * k - vh) / a0;
+  shelf->b2 = (vh - vb * k / q + k * k) / a0;
+  shelf->a1 = 2.0 * (k * k - 1.0) / a0;
+  shelf->a2 = (1.0 - k / q + k * k) / a0;
+
+  k = SDL_tan(pi * 38.13547087602444 / rate);
+  q = 0.5003270373238773;
+  a0 = 1.0 + k / q + k * k;
+  SDL_zerop(high_pass);
+  high_pass->b0 = 1.0;
+  high_pass->b1 = -2.0;
+  high_pass->b2 = 1.0;
+  high_pass->a1 = 2.0 * (k * k - 1.0) / a0;
+  high_pass->a2 = (1.0 - k / q + k * k) / a0;
+}
+
+// the loudness (in LUFS) of a mean square
+static double loudness(double energy) {
+  // log10(x) = ln(x) / ln(10), SDL_log10 needing SDL 2.0.8
+  return -0.691 + 10.0 * SDL_log(energy) / 2.302585092994046;
+}
+
+// measures the integrated loudness of ITU-R BS.1770 of "frames" frames of
+// float samples: the K-weighted mean square over blocks of 400 ms (which
+// overlap by 75%), without the blocks under -70 LUFS, then without those
+// 10 LU under the loudness of the remaining ones. All the channels (there
+// are at most two) have the same weight. The result is -70 if all the
+// blocks are gated.
+static int integrated_loudness(const float* samples, Sint64 frames,
+    int channels, int rate, float* result) {
+  // the blocks are made of 4 segments of 100 ms, whose energy is computed
+  // once; a sound shorter than a block is measured as a single block
+  Sint64 segment_frames = SDL_max(rate / 10, 1);
+  Sint64 segments = frames / segment_frames;
+  int span = 4;
+  if (segments < span) {
+    segment_frames = SDL_max(frames, 1);
+    segments = 1;
+    span = 1;
+  }
+  double* energy = SDL_calloc((size_t) segments, sizeof(double));
+  if (energy == NULL) {
+    SDL_OutOfMemory();
+    return -1;
+  }
+
+  Sint64 const measured = SDL_min(segments * segment_frames, frames);
+  for (int c = 0; c < channels; c++) {
+    NMIX_Biquad shelf;
+    NMIX_Biquad high_pass;
+    k_weighting(&shelf, &high_pass, rate);
+    for (Sint64 i = 0; i < measured; i++) {
+      double const y =
+          biquad(&high_pass, biquad(&shelf, samples[i * channels + c]));
+      energy[i / segment_frames] += y * y;
+    }
+  }
+
+  // the energy of each block is replaced by its mean square
+  Sint64 const blocks = segments - span + 1;
+  for (Sint64 b = 0; b < blocks; b++) {
+    double sum = 0.0;
+    for (int j = 0; j < span; j++) {
+      sum += energy[b + j];
+    }
+    energy[b] = sum / (span * segment_frames);
+  }
+
+  double const absolute_gate =
+      SDL_pow(10.0, (NMIX_SILENT_LOUDNESS + 0.691) / 10.0);
+  double gate = absolute_gate;
+  double sum = 0.0;
+  for (int pass = 0; pass < 2; pass++) {
+    int gated = 0;
+    sum = 0.0;
+    for (Sint64 b = 0; b < blocks; b++) {
+      if (energy[b] > gate) {
+        sum += energy[b];
+        gated++;
+      }
+    }
+    if (gated == 0) {
+      sum = 0.0;
+      break;
+    }
+    sum /= gated;
+    // the relative gate is 10 LU under the loudness of the blocks kept by
+    // the absolute gate
+    gate = SDL_max(absolute_gate, sum / 10.0);
+  }
+
+  *result = sum > 0.0 ? (float) loudness(sum) : NMIX_SILENT_LOUDNESS;
+  SDL_free(energy);
+  return 0;
+}
+
+int NMIX_AnalyzeFileSource(
+    NMIX_FileSource* s, const NMIX_AnalysisOptions* options) {
+  if (s == NULL) {
+    return -1;
+  }
+  if (!s->predecoded) {
+    SDL_SetError("Only predecoded sources can be analyzed.");
+    return -1;
+  }
+  if (NMIX_IsPlaying(s->source)) {
+    SDL_SetError("The source is playing.");
+    return -1;
+  }
+
+  SDL_AudioFormat const format = s->sample->actual.format;
+  int const channels = s->sample->actual.channels;
+  Uint8* data = s->sample->buffer;
+  Sint64 frames = s->sample->buffer_size / frame_size(s);
+
+  // the analysis works on a float copy of the data
+  float* samples = SDL_malloc((size_t) SDL_max(frames * channels, 1) *
+                              sizeof(float));
+  if (samples == NULL) {
+    SDL_OutOfMemory();
+    return -1;
+  }
+  float peak = 0.f;
+  for (Sint64 i = 0; i < frames * channels; i++) {
+    samples[i] = load_sample(data, format, i);
+    peak = SDL_max(peak, (float) SDL_fabs(samples[i]));
+  }
+
+  NMIX_Analysis analysis = {0.f, peak, 1.f, 0, 0};
+  if (integrated_loudness(samples, frames, channels, s->sample->actual.rate,
+          &analysis.loudness) != 0) {
+    SDL_free(samples);
+    return -1;
+  }
+
+  // the silent frames at both ends are found (a silent sound is kept)
+  Sint64 start = 0;
+  Sint64 end = frames;
+  if (options != NULL && options->trim) {
+    float const threshold =
+        (float) SDL_pow(10.f, options->silence_threshold / 20.f);
+    while (start < end) {
+      SDL_bool audible = SDL_FALSE;
+      for (int c = 0; c < channels; c++) {
+        audible |= SDL_fabs(samples[start * channels + c]) > threshold;
+      }
+      if (audible) {
+        break;
+      }
+      start++;
+    }
+    while (end > start) {
+      SDL_bool audible = SDL_FALSE;
+      for (int c = 0; c < channels; c++) {
+        audible |= SDL_fabs(samples[(end - 1) * channels + c]) > threshold;
+      }
+      if (audible) {
+        break;
+      }
+      end--;
+    }
+    if (start == end) {
+      start = 0;
+      end = frames;
+    }
+  }
+
+  // the gain is limited so that the normalized sound doesn't clip
+  if (options != NULL && options->normalize &&
+      analysis.loudness > NMIX_SILENT_LOUDNESS) {
+    analysis.gain = (float) SDL_pow(
+        10.f, (options->target_loudness - analysis.loudness) / 20.f);
+    if (peak * analysis.gain > 1.f) {
+      analysis.gain = 1.f / peak;
+    }
+    for (Sint64 i = start * channels; i < end * channels; i++) {
+      store_sample(data, format, i, samples[i] * analysis.gain);
+    }
+  }
+  SDL_free(samples);
+
+  int result = 0;
+  if (start > 0 || end < frames) {
+    int const size = frame_size(s);
+    SDL_memmove(data, data + start * size, (size_t) ((end - start) * size));
+    if (!Sound_SetBufferSize(s->sample, (Uint32) ((end - start) * size))) {
+      // the sound keeps its length, the end being silent
+      SDL_memset(data + (end - start) * size, format == AUDIO_U8 ? 0x80 : 0,
+          (size_t) ((frames - end + start) * size));
+      SDL_SetError("SDL_sound error: %s", Sound_GetError());
+      result = -1;
+    } else {
+      analysis.trimmed_start = start;
+      analysis.trimmed_end = frames - end;
+      frames = end - start;
+    }
+  }
+
+  // the source is rewound over the new data, and the loop points follow it
+  NMIX_LockMixer(s->source->mixer);
+  s->analysis = analysis;
+  s->length = frames;
+  s->loop_start = SDL_max(s->loop_start - analysis.trimmed_start, 0);
+  if (s->loop_end >= 0) {
+    s->loop_end = SDL_min(s->loop_end - analysis.trimmed_start, frames);
+    if (s->loop_end <= s->loop_start) {
+      s->loop_start = 0;
+      s->loop_end = -1;
+    }
+  }
+  sdlsound_seek(s, 0);
+  NMIX_UnlockMixer(s->source->mixer);
+
+  return result;
+}
+
+// the files loaded by NMIX_LoadFileSources, shared by its threads
+typedef struct NMIX_LoadJobs {
+  NMIX_Mixer* mixer;
+  int count;
+  SDL_RWops** rws;
+  const char** exts;
+  const NMIX_AnalysisOptions* options;
+  NMIX_FileSource** sources;
+  SDL_atomic_t next; // index of the next file to load
+  SDL_atomic_t failures;
+} NMIX_LoadJobs;
+
+static int SDLCALL load_thread(void* data) {
+  NMIX_LoadJobs* jobs = (NMIX_LoadJobs*) data;
+
+  for (;;) {
+    int const i = SDL_AtomicAdd(&jobs->next, 1);
+    if (i >= jobs->count) {
+      return 0;
+    }
+
+    NMIX_FileSource* s = NMIX_NewMixerFileSource(
+        jobs->mixer, jobs->rws[i], jobs->exts[i], SDL_TRUE);
+    if (s != NULL && jobs->options != NULL &&
+        NMIX_AnalyzeFileSource(s, jobs->options) != 0) {
+      NMIX_FreeFileSource(s);
+      s = NULL;
+    }
+    jobs->sources[i] = s;
+    if (s == NULL) {
+      SDL_AtomicAdd(&jobs->failures, 1);
+    }
+  }
+}
+
+int NMIX_LoadFileSources(int count, SDL_RWops** rws, const char** exts,
+    const NMIX_AnalysisOptions* options, NMIX_FileSource** sources) {
+  if (NMIX_GetDefaultMixer() == NULL) {
+    SDL_SetError("Please open NMIX device before creating sources.");
+    return -1;
+  }
+
+  return NMIX_MixerLoadFileSources(
+      NMIX_GetDefaultMixer(), count, rws, exts, options, sources);
+}
+
+int NMIX_MixerLoadFileSources(NMIX_Mixer* mixer, int count, SDL_RWops** rws,
+    const char** exts, const NMIX_AnalysisOptions* options,
+    NMIX_FileSource** sources) {
+  if (mixer == NULL) {
+    SDL_SetError("Please create a mixer before creating sources.");
+    return -1;
+  }
+  if (count < 0 || (count > 0 && (rws == NULL || exts == NULL ||
+                                     sources == NULL))) {
+    SDL_SetError("Invalid files.");
+    return -1;
+  }
+
+  NMIX_LoadJobs jobs;
+  jobs.mixer = mixer;
+  jobs.count = count;
+  jobs.rws = rws;
+  jobs.exts = exts;
+  jobs.options = options;
+  jobs.sources = sources;
+  SDL_AtomicSet(&jobs.next, 0);
+  SDL_AtomicSet(&jobs.failures, 0);
+
+  // the calling thread loads files too; a thread that can't be created
+  // only makes the loading slower
+  SDL_Thread* threads[NMIX_MAX_LOAD_THREADS];
+  int const thread_count =
+      SDL_min(SDL_min(count, SDL_GetCPUCount()), NMIX_MAX_LOAD_THREADS + 1) -
+      1;
+  for (int i = 0; i < thread_count; i++) {
+    threads[i] = SDL_CreateThread(load_thread, "NMIX_Load", &jobs);
+  }
+  load_thread(&jobs);
+  for (int i = 0; i < thread_count; i++) {
+    if (threads[i] != NULL) {
+      SDL_WaitThread(threads[i], NULL);
+    }
+  }
+
+  // the errors are set on the threads that loaded the files
+  int const failures = SDL_AtomicGet(&jobs.failures);
+  if (failures > 0) {
+    SDL_SetError("Cannot load %d of the %d files.", failures, count);
+    return -1;
+  }
+  return 0;
+}
+
+// downmixes decoded data with more than two channels to stereo, returns the
+// new data (or NULL on error) and frees the old one
+static float* downmix(float* data, Uint8 channels, int rate, Sint64* frames) {
+  SDL_AudioStream* stream =
+      SDL_NewAudioStream(AUDIO_F32SYS, channels, rate, AUDIO_F32SYS, 2, rate);
+  float* stereo = SDL_malloc(SDL_max(*frames, 1) * 2 * sizeof(float));
+  if (stream == NULL || stereo == NULL ||
+      SDL_AudioStreamPut(stream, data, *frames * channels * sizeof(float)) ||
+      SDL_AudioStreamFlush(stream) != 0) {
+    SDL_free(stereo);
+    stereo = NULL;
+  } else {
+    int const size = SDL_AudioStreamGet(
+        stream, stereo, *frames * 2 * sizeof(float));
+    *frames = SDL_max(size, 0) / (2 * sizeof(float));
+  }
+
+  if (stream != NULL) {
+    SDL_FreeAudioStream(stream);
+  }
+  SDL_free(data);
+  return stereo;
+}
+
+float* NMIX_DecodeFile(SDL_RWops* rw, const char* ext, int rate,
+    Uint8* channels, Sint64* frames) {
+  if (rate <= 0 || channels == NULL || *channels > 2 || frames == NULL) {
+    SDL_SetError("Invalid decoding format.");
+    return NULL;
+  }
+
+  // SDL_sound converts the data to floats at the requested rate, keeping
+  // the channels of the file if none are requested
+  Sound_AudioInfo desired;
+  desired.format = AUDIO_F32SYS;
+  desired.channels = *channels;
+  desired.rate = rate;
+
+  Sound_Sample* sample = Sound_NewSample(rw, ext, &desired, 65536);
+  if (sample == NULL) {
+    SDL_SetError("SDL_sound error: %s", Sound_GetError());
+    return NULL;
+  }
+
+  Uint32 const size = Sound_DecodeAll(sample);
+  if (sample->flags & SOUND_SAMPLEFLAG_ERROR) {
+    SDL_SetError("SDL_sound error: %s", Sound_GetError());
+    Sound_FreeSample(sample);
+    return NULL;
+  }
+
+  Uint8 const decoded_channels =
+      *channels != 0 ? *channels : sample->actual.channels;
+  float* data = SDL_malloc(SDL_max(size, 1));
+  if (data == NULL) {
+    SDL_OutOfMemory();
+    Sound_FreeSample(sample);
+    return NULL;
+  }
+  SDL_memcpy(data, sample->buffer, size);
+  Sound_FreeSample(sample);
+
+  *frames = size / (decoded_channels * sizeof(float));
+  *channels = decoded_channels;
+  if (decoded_channels > 2) {
+    data = downmix(data, decoded_channels, rate, frames);
+    *channels = 2;
+  }
+  return data;
+}
+
+int NMIX_LoadReverb(SDL_RWops* rw, const char* ext) {
+  if (NMIX_GetDefaultMixer() == NULL) {
+    SDL_SetError("NMIX device is not opened.");
+    return -1;
+  }
+
+  return NMIX_MixerLoadReverb(NMIX_GetDefaultMixer(), rw, ext);
+}
+
+int NMIX_MixerLoadReverb(NMIX_Mixer* mixer, SDL_RWops* rw, const char* ext) {
+  if (mixer == NULL) {
+    SDL_SetError("Please create a mixer before loading a reverb.");
+    return -1;
+  }
+
+  // the impulse response is converted to stereo floats at the mixer rate
+  Uint8 channels = 2;
+  Sint64 frames;
+  float* ir = NMIX_DecodeFile(
+      rw, ext, NMIX_MixerGetAudioSpec(mixer)->freq, &channels, &frames);
+  if (ir == NULL) {
+    return -1;
+  }
+
+  int const result = NMIX_MixerSetReverb(mixer, ir, (int) frames, 2);
+  SDL_free(ir);
+  return result;
 }
 
 void NMIX_FreeFileSource(NMIX_FileSource* s) {
@@ -181,13 +1880,20 @@ void NMIX_FreeFileSource(NMIX_FileSource* s) {
     return;
   }
 
-  SDL_LockAudioDevice(NMIX_GetAudioDevice());
+  // once its job is dropped and its source freed, neither the worker nor
+  // the audio thread use the file source: the worker is stopped without
+  // the mixer lock
+  NMIX_Mixer* mixer = s->source->mixer;
+  lock_cancel_job(s);
+  NMIX_FreeSource(s->source);
+  NMIX_UnlockMixer(mixer);
+
+  release_worker();
+  SDL_free(s->loop_head);
+  SDL_free(s->preroll);
+  SDL_free(s->silence);
   if (s->sample != NULL) {
     Sound_FreeSample(s->sample);
   }
-  if (s->source != NULL) {
-    NMIX_FreeSource(s->source);
-  }
   SDL_free(s);
-  SDL_UnlockAudioDevice(NMIX_GetAudioDevice());
 }
@@ -6,6 +6,40 @@
 #include <SDL_sound.h>
 #include "SDL_nmix.h"
 
+/**
+ * \struct NMIX_AnalysisOptions
+ * \brief What the analysis of a predecoded source does.
+ *
+ * \sa NMIX_AnalyzeFileSource
+ */
+typedef struct NMIX_AnalysisOptions {
+  SDL_bool normalize; /**< Whether the sound is scaled to target_loudness. */
+  float target_loudness; /**< The integrated loudness (in LUFS) of the
+                              normalized sounds, eg -16. The gain is
+                              limited so that the peak stays under full
+                              scale. */
+  SDL_bool trim; /**< Whether the silence at the start and at the end of
+                      the sound is removed. */
+  float silence_threshold; /**< The level (in dBFS, eg -60) under which a
+                                frame is silent. */
+} NMIX_AnalysisOptions;
+
+/**
+ * \struct NMIX_Analysis
+ * \brief The results of the analysis of a predecoded source.
+ *
+ * \sa NMIX_AnalyzeFileSource
+ */
+typedef struct NMIX_Analysis {
+  float loudness; /**< The integrated loudness (in LUFS, ITU-R BS.1770)
+                       before normalization, -70 if the sound is silent. */
+  float peak; /**< The highest absolute sample value before
+                   normalization. */
+  float gain; /**< The gain applied by the normalization (1 if none). */
+  Sint64 trimmed_start; /**< Number of silent frames removed at the start. */
+  Sint64 trimmed_end; /**< Number of silent frames removed at the end. */
+} NMIX_Analysis;
+
 /**
  * \struct NMIX_FileSource
  * \brief Represents a source that is decoded from a file.
@@ -24,8 +58,50 @@ typedef struct NMIX_FileSource {
   SDL_bool loop_on; /**< Whether the source should be looped or not. */
   Uint8* buffer; /**< Pointer to the SDL_sound buffer, at the current
                       position of decoding. */
-  int bytes_left; /**< Number of bytes left to read in SDL_sound buffer. */
+  int bytes_left; /**< Number of bytes left to lend from SDL_sound buffer. */
   SDL_bool predecoded; /**< Set if the source is pre-decoded in memory. */
+  NMIX_Analysis analysis; /**< The results of NMIX_AnalyzeFileSource, all
+                               zeros (but the gain) if not analyzed. */
+  Sint64 position; /**< Current position (in sample frames) of the source. */
+  Sint64 length; /**< Length (in sample frames) of the source, -1 if
+                      unknown. */
+  SDL_bool seek_pending; /**< Set if the decoder must seek to "position"
+                              before decoding more data (see
+                              NMIX_IsVirtual). */
+
+  Sint64 loop_start; /**< First frame played when the source loops. */
+  Sint64 loop_end; /**< Frame at which the source loops, -1 for the end of
+                        the file. */
+  Uint8* loop_head; /**< Decoded data at the loop start of a streamed
+                         source, played while the decoder seeks, NULL if not
+                         cached. */
+  int loop_head_size; /**< Size in bytes of loop_head. */
+  SDL_bool loop_head_complete; /**< Set if loop_head holds the whole loop. */
+  SDL_bool loop_head_cached; /**< Set once loop_head was decoded for the
+                                  current loop points. */
+  SDL_bool in_loop_head; /**< Set if "buffer" points into loop_head. */
+  Uint8* silence; /**< Silent data, played if the decoder is late. */
+  int silence_size; /**< Size in bytes of silence. */
+  Uint8* preroll; /**< Data decoded after a NMIX_SeekAsync. */
+  int preroll_size; /**< Size in bytes of the data decoded in preroll. */
+  int preroll_capacity; /**< Size in bytes of the preroll buffer. */
+  SDL_bool awaiting_preroll; /**< Set if the source waits for its preroll
+                                  (the source is silent). */
+
+  SDL_atomic_t seek_request; /**< Position (in milliseconds) requested by
+                                  NMIX_SeekAsync, -1 if none. */
+  SDL_atomic_t loop_head_request; /**< Set while the worker is asked to
+                                       decode loop_head. */
+  SDL_atomic_t job_state; /**< State of the decoder job (see the decode
+                               worker in SDL_nmix_file.c). */
+  int job_kind; /**< Kind of the decoder job. */
+  int job_ms; /**< Position requested by the seek job. */
+  Sint64 job_frame; /**< Frame at which the job seeks the decoder. */
+  Uint8* job_buffer; /**< Data decoded by the job. */
+  int job_bytes; /**< Size in bytes of job_buffer. */
+  int job_result; /**< Result of the last seek or loop head job. */
+  SDL_bool job_queued; /**< Set if the source is in the job queue. */
+  struct NMIX_FileSource* next_job; /**< Next source in the job queue. */
 } NMIX_FileSource;
 
 /**
@@ -54,6 +130,125 @@ typedef struct NMIX_FileSource {
 NMIX_FileSource* NMIX_NewFileSource(
     SDL_RWops* rw, const char* ext, SDL_bool predecode);
 
+/**
+ * \fn NMIX_FileSource* NMIX_NewMixerFileSource(NMIX_Mixer* mixer,
+ *         SDL_RWops* rw, const char *ext, SDL_bool predecode)
+ * \brief Creates a new NMIX_FileSource played by a given mixer.
+ *
+ * Same as NMIX_NewFileSource, for a mixer other than the default one.
+ *
+ * \sa NMIX_NewFileSource
+ */
+NMIX_FileSource* NMIX_NewMixerFileSource(
+    NMIX_Mixer* mixer, SDL_RWops* rw, const char* ext, SDL_bool predecode);
+
+/**
+ * \fn SDL_RWops* NMIX_NewReadAheadRW(SDL_RWops* rw, int chunk_size,
+ *         int depth)
+ * \brief Wraps a SDL_RWops with a buffer read ahead by a background thread.
+ *
+ * The decoder of a streamed source reads its file from the audio thread,
+ * where a slow disk (or a cold cache) stalls the output. The SDL_RWops
+ * returned reads the file in large sequential chunks from an I/O thread,
+ * shared by all the read-ahead streams, so that the decoder reads from
+ * memory. Pass it to NMIX_NewFileSource (with predecode set to 0) instead of
+ * the file SDL_RWops:
+ *
+ * \code
+ * NMIX_NewFileSource(NMIX_NewReadAheadRW(rw, 0, 0), "ogg", SDL_FALSE);
+ * \endcode
+ *
+ * A read waits for the I/O thread only when the data is not read yet, after
+ * a seek out of the buffer or when the disk is too slow: these stalls are
+ * counted (see NMIX_GetReadAheadStalls). The wrapped SDL_RWops is
+ * closed/freed when the returned one is closed, it is left open on error.
+ *
+ *    \param rw The SDL_RWops to read, which must be able to seek
+ *    \param chunk_size The size (in bytes) of the chunks read by the I/O
+ *           thread, 0 for the default (64 KiB)
+ *    \param depth The number of chunks read ahead of the decoder, 0 for the
+ *           default (4)
+ *   \return The read-ahead SDL_RWops, NULL on error. You can retrieve the
+ *           error message with a call to SDL_GetError()
+ *
+ * \sa NMIX_GetReadAheadStalls
+ */
+SDL_RWops* NMIX_NewReadAheadRW(SDL_RWops* rw, int chunk_size, int depth);
+
+/**
+ * \fn int NMIX_GetReadAheadStalls(SDL_RWops* rw)
+ * \brief Returns the number of reads that waited for the disk.
+ *
+ * A read of a stream made by NMIX_NewReadAheadRW stalls when the data is
+ * not read ahead yet, which is expected after a seek far from the current
+ * position, but means that the prefetch depth is too small otherwise.
+ *
+ *    \param rw A SDL_RWops made by NMIX_NewReadAheadRW (eg the field "rw"
+ *           of a NMIX_FileSource)
+ *   \return The number of stalls since the creation of the stream, 0 if
+ *           the SDL_RWops was not made by NMIX_NewReadAheadRW
+ */
+int NMIX_GetReadAheadStalls(SDL_RWops* rw);
+
+/**
+ * \fn int NMIX_AnalyzeFileSource(NMIX_FileSource* s,
+ *         const NMIX_AnalysisOptions* options)
+ * \brief Analyzes a predecoded source, and normalizes and trims its data.
+ *
+ * The integrated loudness and the peak of the sound are measured and stored
+ * in s->analysis. Depending on the options, the decoded data is then scaled
+ * to a common loudness, so that no gain has to be tuned by hand for each
+ * sound, and the silence at its ends is removed, so that it is neither kept
+ * in memory nor mixed. The positions in the source (eg the loop points)
+ * then start at the first frame kept.
+ *
+ * This must be done before the source is played, it is usually done when
+ * loading (see NMIX_LoadFileSources).
+ *
+ *    \param s The source, created with predecode set to 1
+ *    \param options What to do with the data, NULL to only measure it
+ *   \return zero on success, -1 on error. You can retrieve the error
+ *           message with a call to SDL_GetError()
+ *
+ * \sa NMIX_LoadFileSources
+ */
+int NMIX_AnalyzeFileSource(
+    NMIX_FileSource* s, const NMIX_AnalysisOptions* options);
+
+/**
+ * \fn int NMIX_LoadFileSources(int count, SDL_RWops** rws,
+ *         const char** exts, const NMIX_AnalysisOptions* options,
+ *         NMIX_FileSource** sources)
+ * \brief Creates predecoded sources from several files in parallel.
+ *
+ * The files are decoded (and analyzed, see NMIX_AnalyzeFileSource) by as
+ * many threads as there are CPU cores, the calling thread included, which
+ * divides the loading time of a level by about the number of cores.
+ *
+ *    \param count The number of files
+ *    \param rws The SDL_RWops of the files, as given to NMIX_NewFileSource
+ *    \param exts The extensions of the files (without the point '.')
+ *    \param options The analysis of each source, NULL for none
+ *    \param sources Receives the sources, NULL for the files that failed
+ *   \return zero if all the sources were created, -1 otherwise. You can
+ *           retrieve the error message with a call to SDL_GetError()
+ *
+ * \sa NMIX_NewFileSource
+ */
+int NMIX_LoadFileSources(int count, SDL_RWops** rws, const char** exts,
+    const NMIX_AnalysisOptions* options, NMIX_FileSource** sources);
+
+/**
+ * \fn int NMIX_MixerLoadFileSources(NMIX_Mixer* mixer, int count,
+ *         SDL_RWops** rws, const char** exts,
+ *         const NMIX_AnalysisOptions* options, NMIX_FileSource** sources)
+ * \brief Same as NMIX_LoadFileSources, for a mixer other than the default
+ *        one.
+ */
+int NMIX_MixerLoadFileSources(NMIX_Mixer* mixer, int count, SDL_RWops** rws,
+    const char** exts, const NMIX_AnalysisOptions* options,
+    NMIX_FileSource** sources);
+
 /**
  * \fn Sint32 NMIX_GetDuration(NMIX_FileSource* s)
  * \brief Returns the duration (in milliseconds) of a NMIX_FileSource.
@@ -68,17 +263,104 @@ Sint32 NMIX_GetDuration(NMIX_FileSource* s);
  * \fn int NMIX_Seek(NMIX_FileSource* s, int ms)
  * \brief Modifies a NMIX_FileSource position.
  *
+ * This is a shortcut for NMIX_SeekSource, so the seek can be recorded in a
+ * batch (see NMIX_BeginBatch). Use NMIX_SeekSource to seek to a given
+ * sample frame.
+ *
+ * On a predecoded source, seeking only moves the read position in memory:
+ * it is frame-accurate and costs nothing. On a streamed source, SDL_sound
+ * seeks in the file, with a millisecond precision.
+ *
  *    \param s The file source to seek
  *   \param ms The new position in milliseconds from the beginning of the source
  *   \return zero on success, -1 on error. You can retrieve the error message
  *           with a call to SDL_GetError()
+ *
+ * \sa NMIX_GetPosition
+ * \sa NMIX_SeekAsync
  */
 int NMIX_Seek(NMIX_FileSource* s, int ms);
 
+/**
+ * \fn int NMIX_SeekAsync(NMIX_FileSource* s, int ms)
+ * \brief Modifies a NMIX_FileSource position without waiting for the
+ *        decoder.
+ *
+ * The seek is done by a background thread, which also decodes the
+ * beginning of the audio at the new position (the preroll, see
+ * NMIX_SetPreroll). The source is silent until then, and the new data is
+ * swapped in at the beginning of a buffer, so the playback after the seek
+ * doesn't wait for the decoder. Neither the calling thread nor the audio
+ * thread waits for SDL_sound.
+ *
+ * Calling NMIX_SeekAsync on a paused source prepares it to be played:
+ * once the preroll is decoded, NMIX_Play starts it without delay.
+ *
+ * On a predecoded source, the seek is done before the next buffer.
+ *
+ *    \param s The file source to seek
+ *   \param ms The new position in milliseconds from the beginning of the source
+ *   \return zero on success, -1 on error. You can retrieve the error message
+ *           with a call to SDL_GetError()
+ *
+ * \sa NMIX_Seek
+ * \sa NMIX_SetPreroll
+ */
+int NMIX_SeekAsync(NMIX_FileSource* s, int ms);
+
+/**
+ * \fn int NMIX_GetPreroll(NMIX_FileSource* s)
+ * \brief Returns the duration of the audio decoded by NMIX_SeekAsync.
+ *
+ *    \param s The file source to query
+ *   \return The duration in milliseconds, 0 for a predecoded source
+ *
+ * \sa NMIX_SetPreroll
+ */
+int NMIX_GetPreroll(NMIX_FileSource* s);
+
+/**
+ * \fn int NMIX_SetPreroll(NMIX_FileSource* s, int ms)
+ * \brief Sets the duration of the audio decoded by NMIX_SeekAsync.
+ *
+ * The preroll should cover the time the decoder takes to decode the data
+ * that follows (default = 100 ms). Predecoded sources have no preroll.
+ *
+ *    \param s The file source to modify
+ *    \param ms The duration in milliseconds
+ *   \return zero on success, -1 on error. You can retrieve the error message
+ *           with a call to SDL_GetError()
+ *
+ * \sa NMIX_SeekAsync
+ */
+int NMIX_SetPreroll(NMIX_FileSource* s, int ms);
+
+/**
+ * \fn Sint64 NMIX_GetPosition(NMIX_FileSource* s)
+ * \brief Returns the position of a NMIX_FileSource.
+ *
+ * The position is the next frame that will be read by the mixer. Note that
+ * a source read through a SDL_AudioStream (see NMIX_NewSource) may have
+ * converted a few frames ahead of what was actually heard.
+ *
+ *    \param s The file source to query
+ *   \return The position in sample frames (at the rate of the file) from the
+ *           beginning of the source, -1 on error
+ *
+ * \sa NMIX_Seek
+ * \sa NMIX_SeekSource
+ */
+Sint64 NMIX_GetPosition(NMIX_FileSource* s);
+
 /**
  * \fn int NMIX_Rewind(NMIX_FileSource* s)
  * \brief Rewinds a NMIX_FileSource.
  *
+ * The decoder of a streamed source is rewound by the background thread, as
+ * with NMIX_SeekAsync, and this function waits until it is done: the mixer
+ * is not locked meanwhile, so it must not be called while the calling
+ * thread holds the mixer lock (see NMIX_LockMixer).
+ *
  *    \param s The file source to rewind
  *   \return zero on success, -1 on error. You can retrieve the error message
  *           with a call to SDL_GetError()
@@ -97,15 +379,118 @@ int NMIX_Rewind(NMIX_FileSource* s);
 SDL_bool NMIX_GetLoop(NMIX_FileSource* s);
 
 /**
- * \fn void NMIX_SetLoop(NMIX_FileSource* s, SDL_bool loop_on)
+ * \fn int NMIX_SetLoop(NMIX_FileSource* s, SDL_bool loop_on)
  * \brief Sets whether a NMIX_FileSource is looped or not.
  *
+ * A looped source sends a NMIX_EVENT_LOOPED event each time it goes back
+ * to its loop start (see NMIX_PollEvent).
+ *
+ * Turning the loop on decodes the loop head of a streamed source (see
+ * NMIX_SetLoopPoints), and has the same constraints as NMIX_Rewind.
+ *
  *    \param s The file source to query.
  *    \param loop_on Whether the file source is looped (1) or not (0).
+ *   \return zero on success, -1 on error. You can retrieve the error message
+ *           with a call to SDL_GetError()
  *
  * \sa NMIX_GetLoop
+ * \sa NMIX_SetLoopPoints
+ */
+int NMIX_SetLoop(NMIX_FileSource* s, SDL_bool loop_on);
+
+/**
+ * \fn int NMIX_SetLoopPoints(NMIX_FileSource* s, Sint64 start, Sint64 end)
+ * \brief Sets the region of a NMIX_FileSource that is looped.
+ *
+ * When the loop is on (see NMIX_SetLoop), the source plays from its current
+ * position to "end", then goes back to "start": the part before "start" is
+ * played once, like the intro of a music. By default, the whole file is
+ * looped.
+ *
+ * A streamed source keeps the decoded audio at "start" in memory: when the
+ * source loops, this audio is played while the decoder seeks in a
+ * background thread, so the loop is seamless and doesn't cost decoding time
+ * on the audio thread. This memory is filled by the background thread when
+ * the loop is turned on or the loop points change, and this function waits
+ * for it (see NMIX_Rewind): a playing source is silent meanwhile, so this
+ * should be done at load time. The decoders that can't seek (eg MIDI) only
+ * keep this memory for a loop starting at 0.
+ *
+ *    \param s The file source to modify
+ *    \param start The first frame of the loop
+ *    \param end The frame at which the source loops back to "start", -1 for
+ *           the end of the file
+ *   \return zero on success, -1 on error. You can retrieve the error message
+ *           with a call to SDL_GetError()
+ *
+ * \sa NMIX_SetLoop
+ * \sa NMIX_GetLoopPoints
+ */
+int NMIX_SetLoopPoints(NMIX_FileSource* s, Sint64 start, Sint64 end);
+
+/**
+ * \fn void NMIX_GetLoopPoints(NMIX_FileSource* s, Sint64* start,
+ *         Sint64* end)
+ * \brief Returns the region of a NMIX_FileSource that is looped.
+ *
+ *    \param s The file source to query
+ *    \param start Receives the first frame of the loop (can be NULL)
+ *    \param end Receives the frame at which the source loops, -1 for the end
+ *           of the file (can be NULL)
+ *
+ * \sa NMIX_SetLoopPoints
+ */
+void NMIX_GetLoopPoints(NMIX_FileSource* s, Sint64* start, Sint64* end);
+
+/**
+ * \fn float* NMIX_DecodeFile(SDL_RWops* rw, const char* ext, int rate,
+ *         Uint8* channels, Sint64* frames)
+ * \brief Decodes a whole file into float samples.
+ *
+ * The file is decoded by SDL_sound, and converted to AUDIO_F32SYS samples
+ * at the given rate, which the mixer reads without conversion when it is
+ * its rate. This is used by the tools that prepare data offline (see
+ * NMIX_WriteBank). The SDL_RWops is closed/freed.
+ *
+ *    \param rw A SDL_RWops that points to the file to decode
+ *    \param ext The file extension (without the point '.'), eg "ogg"
+ *    \param rate The sampling rate of the decoded data
+ *    \param channels The number of channels of the decoded data: 1 or 2, or
+ *           0 to keep mono and stereo files as they are (the files with more
+ *           channels are downmixed to stereo). Receives the number of
+ *           channels of the data.
+ *    \param frames Receives the number of sample frames decoded
+ *   \return The samples (interleaved), to free with SDL_free, NULL on
+ *           error. You can retrieve the error message with a call to
+ *           SDL_GetError()
+ */
+float* NMIX_DecodeFile(SDL_RWops* rw, const char* ext, int rate,
+    Uint8* channels, Sint64* frames);
+
+/**
+ * \fn int NMIX_LoadReverb(SDL_RWops* rw, const char* ext)
+ * \brief Loads the impulse response of the reverb from a file.
+ *
+ * The file is decoded by SDL_sound and converted to the mixer rate, then
+ * set with NMIX_SetReverb. The SDL_RWops is closed/freed once the file is
+ * decoded.
+ *
+ *    \param rw A SDL_RWops that points to the file to decode
+ *    \param ext The file extension (without the point '.'), eg "wav"
+ *   \return zero on success, -1 on error. You can retrieve the error message
+ *           with a call to SDL_GetError()
+ *
+ * \sa NMIX_SetReverb
+ * \sa NMIX_SetReverbSend
+ */
+int NMIX_LoadReverb(SDL_RWops* rw, const char* ext);
+
+/**
+ * \fn int NMIX_MixerLoadReverb(NMIX_Mixer* mixer, SDL_RWops* rw,
+ *         const char* ext)
+ * \brief Same as NMIX_LoadReverb, for a given mixer.
  */
-void NMIX_SetLoop(NMIX_FileSource* s, SDL_bool loop_on);
+int NMIX_MixerLoadReverb(NMIX_Mixer* mixer, SDL_RWops* rw, const char* ext);
 
 /**
  * \fn void NMIX_FreeFileSource(NMIX_FileSource* s)
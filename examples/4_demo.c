@@ -2,23 +2,11 @@
 // rewind music, 'd' to play a sound and 'f' to toggle sine wave; 'q' to exit
 
 #include <stdio.h>
-#include <math.h>
 #include <SDL.h>
 
 #include "../SDL_nmix.h"
 #include "../SDL_nmix_file.h"
 
-static void sine_callback(void* userdata, void* _stream, int len) {
-  float* stream = (float*) _stream;
-  double* x = (double*) userdata;
-
-  float freq = 261.63; // C4
-  for (size_t i = 0; i < len / sizeof(float); i++) {
-    *x += (double) 1 / 44100;
-    stream[i] = sinf(freq * (*x) * 2 * M_PI);
-  }
-}
-
 int main(int argc, char** argv) {
   SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO);
 
@@ -52,10 +40,8 @@ int main(int argc, char** argv) {
   NMIX_SetGain(source2->source, .6);
   NMIX_SetPan(source2->source, -.2);
 
-  // setup third source: sine wave
-  double x = 0;
-  NMIX_Source* source3 =
-      NMIX_NewSource(AUDIO_F32SYS, 1, 44100, sine_callback, &x);
+  // setup third source: sine wave, generated by the mixer
+  NMIX_Source* source3 = NMIX_NewOscillator(NMIX_WAVE_SINE, 261.63f); // C4
   if (source3 == NULL) {
     fprintf(stderr, "Error: %s\n", SDL_GetError());
     return 1;
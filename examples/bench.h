@@ -0,0 +1,124 @@
+// bench.h: the workload and the measures shared by the benchmarks of
+//          SDL_nmix (test_nmix.c) and SDL_mixer (test_sdlmixer.c), so that
+//          both libraries mix the same sounds and are measured the same way.
+//
+// Both benchmarks run without an audio device (e.g. on a CI box), as fast
+// as the library mixes, and print the CPU time used by the whole process
+// (the library threads included) per second of audio mixed, and the peak
+// memory of the process. The resampling cost is measured by passing a rate
+// different from the rate of the files, e.g.:
+//
+//   test_nmix -n 32 -m 1 -r 44100 sound.ogg music.ogg
+//   test_nmix -n 32 -m 1 -r 48000 sound.ogg music.ogg
+//   test_sdlmixer -n 32 -m 1 -r 44100 sound.ogg music.ogg
+//   test_sdlmixer -n 32 -m 1 -r 48000 sound.ogg music.ogg
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <SDL.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// number of sample frames mixed at a time
+#define BENCH_SAMPLES 1024
+
+typedef struct Bench {
+  int sfx; // number of predecoded sound effects, looped
+  int streams; // number of streamed files, looped
+  int rate; // rate of the mix, in Hz
+  int seconds; // duration of audio to mix
+  const char* sfx_file;
+  const char* stream_file;
+} Bench;
+
+// parses "[-n sfx] [-m streams] [-r rate] [-t seconds] sfx_file
+// stream_file", returns 0 on success
+static int bench_parse(Bench* b, int argc, char** argv) {
+  b->sfx = 32;
+  b->streams = 1;
+  b->rate = 44100;
+  b->seconds = 60;
+
+  int i = 1;
+  for (; i + 1 < argc && argv[i][0] == '-'; i += 2) {
+    int const value = atoi(argv[i + 1]);
+    if (SDL_strcmp(argv[i], "-n") == 0 && value >= 0) {
+      b->sfx = value;
+    } else if (SDL_strcmp(argv[i], "-m") == 0 && value >= 0) {
+      b->streams = value;
+    } else if (SDL_strcmp(argv[i], "-r") == 0 && value > 0) {
+      b->rate = value;
+    } else if (SDL_strcmp(argv[i], "-t") == 0 && value > 0) {
+      b->seconds = value;
+    } else {
+      break;
+    }
+  }
+
+  if (argc - i != 2) {
+    fprintf(stderr,
+        "usage: %s [-n sfx] [-m streams] [-r rate] [-t seconds] "
+        "sfx_file stream_file\n",
+        argv[0]);
+    return -1;
+  }
+  b->sfx_file = argv[i];
+  b->stream_file = argv[i + 1];
+  return 0;
+}
+
+// returns the CPU time (in seconds) used by all the threads of the process
+static double bench_cpu_time(void) {
+#ifdef _WIN32
+  FILETIME creation, exit_time, kernel, user;
+  GetProcessTimes(
+      GetCurrentProcess(), &creation, &exit_time, &kernel, &user);
+  ULARGE_INTEGER k, u;
+  k.LowPart = kernel.dwLowDateTime;
+  k.HighPart = kernel.dwHighDateTime;
+  u.LowPart = user.dwLowDateTime;
+  u.HighPart = user.dwHighDateTime;
+  return (double) (k.QuadPart + u.QuadPart) * 1e-7;
+#else
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+         (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+#endif
+}
+
+// returns the peak memory (resident set size, in KiB) of the process
+static long bench_peak_memory(void) {
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters;
+  GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+  return (long) (counters.PeakWorkingSetSize / 1024);
+#else
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return (long) (usage.ru_maxrss / 1024); // in bytes on macOS
+#else
+  return (long) usage.ru_maxrss;
+#endif
+#endif
+}
+
+// prints the results, in the same format for both libraries
+static void bench_report(
+    const char* library, const Bench* b, double cpu_time, double audio_time) {
+  printf("%s: %d sfx, %d stream(s), %d Hz, %.1f s of audio: "
+         "%.3f ms of CPU per second of audio, peak memory %ld KiB\n",
+      library, b->sfx, b->streams, b->rate, audio_time,
+      cpu_time * 1000 / audio_time, bench_peak_memory());
+}
+
+#endif // BENCH_H
@@ -0,0 +1,110 @@
+// nmix_pack.c: packs sound files into a sound bank, decoded and converted
+//              to the mixer format, which starts playing without decoding
+//              (see SDL_nmix_bank.h)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <SDL.h>
+
+#include "../SDL_nmix.h"
+#include "../SDL_nmix_bank.h"
+#include "../SDL_nmix_file.h"
+
+// the name of an entry is the file name, without its directory and its
+// extension
+static int entry_name(char* name, const char* path) {
+  const char* base = path;
+  for (const char* c = path; *c != '\0'; c++) {
+    if (*c == '/' || *c == '\\') {
+      base = c + 1;
+    }
+  }
+
+  const char* ext = SDL_strrchr(base, '.');
+  size_t const length = ext != NULL ? (size_t) (ext - base) : SDL_strlen(base);
+  if (length >= NMIX_BANK_NAME_SIZE) {
+    return -1;
+  }
+  SDL_memcpy(name, base, length);
+  name[length] = '\0';
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 4) {
+    fprintf(stderr, "usage: %s bank_file rate sound_files...\n", argv[0]);
+    return 1;
+  }
+
+  int const rate = atoi(argv[2]);
+  int const count = argc - 3;
+  if (rate <= 0) {
+    fprintf(stderr, "Error: invalid rate %s\n", argv[2]);
+    return 1;
+  }
+
+  Sound_Init();
+
+  NMIX_BankEntry* entries = SDL_calloc(count, sizeof(NMIX_BankEntry));
+  if (entries == NULL) {
+    fprintf(stderr, "Error: out of memory\n");
+    return 1;
+  }
+
+  int result = 0;
+  for (int i = 0; i < count && result == 0; i++) {
+    const char* path = argv[i + 3];
+    if (entry_name(entries[i].name, path) != 0) {
+      fprintf(stderr, "Error: the name of %s is too long\n", path);
+      result = 1;
+      break;
+    }
+
+    SDL_RWops* f = SDL_RWFromFile(path, "rb");
+    if (f == NULL) {
+      fprintf(stderr, "Error: cannot open file %s\n", path);
+      result = 1;
+      break;
+    }
+
+    const char* ext = SDL_strrchr(path, '.');
+    if (ext != NULL) {
+      ext += 1; // to remove the '.'
+    }
+
+    // mono sounds stay mono, the mixer pans them
+    Uint8 channels = 0;
+    Sint64 frames;
+    entries[i].samples = NMIX_DecodeFile(f, ext, rate, &channels, &frames);
+    if (entries[i].samples == NULL) {
+      fprintf(stderr, "Error: cannot decode %s: %s\n", path, SDL_GetError());
+      result = 1;
+      break;
+    }
+    entries[i].frames = frames;
+    entries[i].channels = channels;
+    printf("%s: %d channel(s), %d ms\n", entries[i].name, channels,
+        (int) (frames * 1000 / rate));
+  }
+
+  if (result == 0) {
+    SDL_RWops* bank = SDL_RWFromFile(argv[1], "wb");
+    if (bank == NULL || NMIX_WriteBank(bank, rate, entries, count) != 0) {
+      fprintf(stderr, "Error: cannot write %s: %s\n", argv[1],
+          SDL_GetError());
+      result = 1;
+    }
+    if (bank != NULL) {
+      SDL_RWclose(bank);
+    }
+  }
+
+  for (int i = 0; i < count; i++) {
+    SDL_free((float*) entries[i].samples);
+  }
+  SDL_free(entries);
+  Sound_Quit();
+  SDL_Quit();
+
+  return result;
+}
@@ -1,49 +1,90 @@
+// test_nmix.c: benchmark of SDL_nmix, to compare with SDL_mixer (see
+//              test_sdlmixer.c and bench.h). The sources are mixed offline
+//              by a mixer without device, as fast as possible.
+
 #include <stdio.h>
 #include <SDL.h>
 
 #include "../SDL_nmix.h"
 #include "../SDL_nmix_file.h"
+#include "bench.h"
 
-#define PREDECODED_SOURCE 0
+// returns the extension of a file name, without the '.'
+static const char* file_ext(const char* filename) {
+  const char* ext = SDL_strrchr(filename, '.');
+  return ext != NULL ? ext + 1 : NULL;
+}
 
 int main(int argc, char** argv) {
-    if (argc != 2) {
-        printf("usage: %s filename", argv[0]);
-        return 1;
-    }
-    const char* filename = argv[1];
+  Bench b;
+  if (bench_parse(&b, argc, argv) != 0) {
+    return 1;
+  }
 
-    if (NMIX_OpenAudio(NMIX_DEFAULT_DEVICE, NMIX_DEFAULT_FREQUENCY, NMIX_DEFAULT_SAMPLES) != 0) {
-        fprintf(stderr, "NMIX Error: %s\n", SDL_GetError());
-    }
-    Sound_Init();
+  NMIX_Mixer* mixer = NMIX_NewMixer(b.rate, BENCH_SAMPLES);
+  if (mixer == NULL) {
+    fprintf(stderr, "NMIX Error: %s\n", SDL_GetError());
+    return 1;
+  }
+  Sound_Init();
 
-    SDL_RWops* f = SDL_RWFromFile(filename, "rb");
-    if (f == NULL) {
-        fprintf(stderr, "Error: cannot open file %s\n", filename);
-        return 1;
-    }
+  int const count = b.sfx + b.streams;
+  SDL_RWops** rws = SDL_calloc(SDL_max(count, 1), sizeof(SDL_RWops*));
+  const char** exts = SDL_calloc(SDL_max(count, 1), sizeof(const char*));
+  NMIX_FileSource** sources =
+      SDL_calloc(SDL_max(count, 1), sizeof(NMIX_FileSource*));
+  if (rws == NULL || exts == NULL || sources == NULL) {
+    fprintf(stderr, "Error: out of memory\n");
+    return 1;
+  }
 
-    const char* ext = SDL_strrchr(filename, '.');
-    if (ext != NULL) {
-        ext += 1; // to remove the '.'
+  // every source decodes its own copy of the file, as SDL_mixer does
+  for (int i = 0; i < count; i++) {
+    const char* filename = i < b.sfx ? b.sfx_file : b.stream_file;
+    rws[i] = SDL_RWFromFile(filename, "rb");
+    exts[i] = file_ext(filename);
+    if (rws[i] == NULL) {
+      fprintf(stderr, "Error: cannot open file %s\n", filename);
+      return 1;
     }
+  }
 
-    NMIX_FileSource* source1 = NMIX_NewFileSource(f, ext,
-        PREDECODED_SOURCE);
-    if (source1 == NULL) {
-        fprintf(stderr, "NMIX Error: %s\n", SDL_GetError());
-        return 1;
+  if (NMIX_MixerLoadFileSources(mixer, b.sfx, rws, exts, NULL, sources) !=
+      0) {
+    fprintf(stderr, "NMIX Error: %s\n", SDL_GetError());
+    return 1;
+  }
+  for (int i = b.sfx; i < count; i++) {
+    sources[i] = NMIX_NewMixerFileSource(mixer, rws[i], exts[i], SDL_FALSE);
+    if (sources[i] == NULL) {
+      fprintf(stderr, "NMIX Error: %s\n", SDL_GetError());
+      return 1;
     }
-    NMIX_SetLoop(source1, 1);
-    NMIX_Play(source1->source);
+  }
+  for (int i = 0; i < count; i++) {
+    NMIX_SetLoop(sources[i], SDL_TRUE);
+    NMIX_Play(sources[i]->source);
+  }
 
-    SDL_Delay(30 * 1000);
+  float buffer[BENCH_SAMPLES * 2];
+  Sint64 frames = 0;
+  double const start = bench_cpu_time();
+  while (frames < (Sint64) b.seconds * b.rate) {
+    NMIX_MixerRender(mixer, buffer, sizeof(buffer));
+    frames += BENCH_SAMPLES;
+  }
+  double const cpu_time = bench_cpu_time() - start;
+  bench_report("SDL_nmix", &b, cpu_time, (double) frames / b.rate);
 
-    NMIX_FreeFileSource(source1);
-    NMIX_CloseAudio();
-    Sound_Quit();
-    SDL_Quit();
+  for (int i = 0; i < count; i++) {
+    NMIX_FreeFileSource(sources[i]);
+  }
+  SDL_free(sources);
+  SDL_free((void*) exts);
+  SDL_free(rws);
+  NMIX_FreeMixer(mixer);
+  Sound_Quit();
+  SDL_Quit();
 
-    return 0;
+  return 0;
 }
@@ -1,66 +1,111 @@
+// test_sdlmixer.c: benchmark of SDL_mixer, to compare with SDL_nmix (see
+//                  test_nmix.c and bench.h). SDL_mixer can't mix offline:
+//                  it plays on the "disk" audio driver, which writes the
+//                  audio to a null file without waiting between buffers.
+
 #include <stdio.h>
 #include <SDL.h>
 
 #include <SDL_mixer.h>
 
-#define PREDECODED_SOURCE 0
+#include "bench.h"
 
-int main(int argc, char** argv) {
-    if (argc != 2) {
-        printf("usage: %s filename", argv[0]);
-        return 1;
-    }
-    const char* filename = argv[1];
+#ifdef _WIN32
+#define NULL_FILE "NUL"
+#else
+#define NULL_FILE "/dev/null"
+#endif
 
-    SDL_Init(SDL_INIT_AUDIO);
-    int flags = MIX_INIT_OGG;
-    if ((Mix_Init(flags) & flags) != flags) {
-        printf("error initialising SDL_mixer: %s\n", Mix_GetError());
-        return 1;
-    }
-    if (Mix_OpenAudioDevice(44100, AUDIO_F32SYS, 2, 4096, NULL, 0) == -1) {
-        printf("error initialising SDL_mixer: %s\n", Mix_GetError());
-        return 1;
-    }
-    int channels = 32;
-    if (Mix_AllocateChannels(channels) != channels) {
-        printf("error allocating %d channels\n", channels);
-    }
+// counts the sample frames mixed
+static void SDLCALL count_frames(void* udata, Uint8* stream, int len) {
+  (void) stream;
+  SDL_AtomicAdd((SDL_atomic_t*) udata, len / (int) (2 * sizeof(float)));
+}
 
-    SDL_RWops* f = SDL_RWFromFile(filename, "rb");
-    if (f == NULL) {
-        fprintf(stderr, "Error: cannot open file %s\n", filename);
-        return 1;
-    }
+int main(int argc, char** argv) {
+  Bench b;
+  if (bench_parse(&b, argc, argv) != 0) {
+    return 1;
+  }
+  if (b.streams > 1) {
+    printf("SDL_mixer streams a single music: using 1 stream\n");
+    b.streams = 1;
+  }
 
-    #if PREDECODED_SOURCE
-    Mix_Chunk* source1 = Mix_LoadWAV_RW(f, 1);
-    #else
-    Mix_Music* source1 = Mix_LoadMUS_RW(f, 1);
-    #endif
+  // the driver can be overridden (e.g. SDL_AUDIODRIVER=dummy)
+  SDL_setenv("SDL_AUDIODRIVER", "disk", 0);
+  SDL_setenv("SDL_DISKAUDIOFILE", NULL_FILE, 0);
+  SDL_setenv("SDL_DISKAUDIODELAY", "0", 0);
 
-    if (source1 == NULL) {
-        printf("Error: %s\n", Mix_GetError());
-        return 1;
+  SDL_Init(SDL_INIT_AUDIO);
+  int flags = MIX_INIT_OGG;
+  if ((Mix_Init(flags) & flags) != flags) {
+    printf("error initialising SDL_mixer: %s\n", Mix_GetError());
+    return 1;
+  }
+  if (Mix_OpenAudioDevice(b.rate, AUDIO_F32SYS, 2, BENCH_SAMPLES, NULL, 0) ==
+      -1) {
+    printf("error initialising SDL_mixer: %s\n", Mix_GetError());
+    return 1;
+  }
+  if (Mix_AllocateChannels(b.sfx) != b.sfx) {
+    printf("error allocating %d channels\n", b.sfx);
+  }
+
+  // every channel plays its own copy of the sound effect, as SDL_nmix does
+  Mix_Chunk** chunks = SDL_calloc(SDL_max(b.sfx, 1), sizeof(Mix_Chunk*));
+  if (chunks == NULL) {
+    fprintf(stderr, "Error: out of memory\n");
+    return 1;
+  }
+  for (int i = 0; i < b.sfx; i++) {
+    chunks[i] = Mix_LoadWAV_RW(SDL_RWFromFile(b.sfx_file, "rb"), 1);
+    if (chunks[i] == NULL) {
+      printf("Error: %s\n", Mix_GetError());
+      return 1;
     }
+  }
 
-    #if PREDECODED_SOURCE
-    Mix_PlayChannel(-1, source1, -1);
-    #else
-    Mix_PlayMusic(source1, -1);
-    #endif
+  Mix_Music* music = NULL;
+  if (b.streams > 0) {
+    music = Mix_LoadMUS_RW(SDL_RWFromFile(b.stream_file, "rb"), 1);
+    if (music == NULL) {
+      printf("Error: %s\n", Mix_GetError());
+      return 1;
+    }
+  }
 
-    SDL_Delay(30 * 1000);
+  // the sounds play once they are all loaded
+  SDL_atomic_t frames;
+  SDL_AtomicSet(&frames, 0);
+  Mix_SetPostMix(count_frames, &frames);
+  double const start = bench_cpu_time();
+  for (int i = 0; i < b.sfx; i++) {
+    Mix_PlayChannel(i, chunks[i], -1);
+  }
+  if (music != NULL) {
+    Mix_PlayMusic(music, -1);
+  }
+  while (SDL_AtomicGet(&frames) < b.seconds * b.rate) {
+    SDL_Delay(1);
+  }
+  double const cpu_time = bench_cpu_time() - start;
+  double const audio_time = (double) SDL_AtomicGet(&frames) / b.rate;
+  Mix_SetPostMix(NULL, NULL);
+  bench_report("SDL_mixer", &b, cpu_time, audio_time);
 
-    #if PREDECODED_SOURCE
-    Mix_FreeChunk(source1);
-    #else
-    Mix_FreeMusic(source1);
-    #endif
+  Mix_HaltChannel(-1);
+  for (int i = 0; i < b.sfx; i++) {
+    Mix_FreeChunk(chunks[i]);
+  }
+  SDL_free(chunks);
+  if (music != NULL) {
+    Mix_FreeMusic(music);
+  }
 
-    Mix_CloseAudio();
-    Mix_Quit();
-    SDL_Quit();
+  Mix_CloseAudio();
+  Mix_Quit();
+  SDL_Quit();
 
-    return 0;
+  return 0;
 }